@@ -18,12 +18,17 @@
 
 #include <assert.h>
 
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <stdio.h>
 #include <string.h>
 #include <signal.h>
 
+#ifdef __linux__
+#  include <sys/signalfd.h>
+#endif
+
 #include "application.hpp"
 
 /** Whether to send /ui/msg/debug signal when signal is delivered. */
@@ -37,6 +42,30 @@ bool Module::isActiveUI() const {
 }
 
 
+void Module::handleFD(int fd, unsigned events) {
+	(void)fd; (void)events;
+}
+
+
+void Module::handleTimer(Timer &timer) {
+	(void)timer;
+}
+
+
+void Module::internRecievers() {
+	if (moduleName.empty() || moduleName[0] != '/') {
+		return;
+	}
+
+	std::string::size_type pos = 0;
+	while ((pos = moduleName.find('/', pos)) != std::string::npos) {
+		recievers.push_back(Signal::intern(moduleName.substr(0, ++pos)));
+	}
+	recievers.push_back(moduleId);
+	std::sort(recievers.begin(), recievers.end());
+}
+
+
 
 char sharedBuffer[1024];
 
@@ -87,7 +116,6 @@ static const int signalNumbers[] = {
 #if SIGWINCH
 	SIGWINCH,
 #endif
-	SIGALRM
 };
 
 
@@ -130,48 +158,45 @@ int Core::run() {
 		}
 	}
 
+	/* If possible read signals from a descriptor so they won't
+	   interrupt anything.  Signals stay blocked all the time then. */
+#ifdef __linux__
+	signalFD = signalfd(-1, &act.sa_mask, 0);
+	if (signalFD >= 0) {
+		fcntl(signalFD, F_SETFD, FD_CLOEXEC);
+		FileDescriptor::setNonBlocking(signalFD);
+		watchFD(signalFD, Poller::READ);
+	}
+#endif
+
 
 	if (!ui_modules) {
 		killModules("/");
 	}
 	deliverSignals();
 
-	alarm(1);
+	startTimer(tickTimer, 1000, 1000);
 	while (modules.size() > 1) {
-		fd_set rd, wr, ex;
-		int nfds = 0;
-
-		FD_ZERO(&rd);
-		FD_ZERO(&wr);
-		FD_ZERO(&ex);
-
-		for (Modules::iterator it = modules.begin(), end = modules.end();
-		     it!=end; ++it) {
-			int n = it->second->setFDSets(&rd, &wr, &ex);
-			if (n > nfds) nfds = n;
-		}
-
-		nfds = pselect(nfds + 1, &rd, &wr, &ex, 0, &oldsigset);
-		if (nfds > 0) {
-			for (Modules::iterator it = modules.begin(), end = modules.end();
-			     it!=end && nfds > 0; ++it) {
-				nfds -= it->second->doFDs(nfds, &rd, &wr, &ex);
-			}
-			assert(nfds == 0);
-		} else if (nfds == 0) {
-			assert(0);
-			fputs("pselect: returned 0\n", stderr);
-			break;
+		if (poller->poll(timers.getTimeout(),
+		                 signalFD < 0 ? &oldsigset : 0) >= 0) {
+			/* nothing */
 		} else if (errno != EINTR) {
-			perror("pselect");
+			perror("poll");
 			break;
 		} else {
 			handleUnixSignals();
 		}
 
+		timers.run();
 		deliverSignals();
 	}
-	alarm(0);
+	tickTimer.stop();
+
+	if (signalFD >= 0) {
+		unwatchFD(signalFD);
+		close(signalFD);
+		signalFD = -1;
+	}
 
 
 	for (unsigned i=0; i < sizeof signalNumbers/sizeof *signalNumbers; ++i) {
@@ -210,33 +235,61 @@ void Core::deliverSignals() {
 		/* FIXME: Shall be removed in production code */
 #if PPC_CORE_DEBUG_SIGNALS
 		sprintf(sharedBuffer, "%3lu: ", Core::getTicks());
-		std::string message = sharedBuffer + signals.front().getType() +
-			" from " + signals.front().getSender() + " to " +
-			signals.front().getReciever();
-		Signal sig("/ui/msg/debug", moduleName, "/ui/",
-		           new sig::StringData(message));
-		std::pair<Modules::iterator, Modules::iterator> it
-			= matchingModules(sig.getReciever());
-		for (; it.first != it.second; ++it.first) {
-			it.first->second->recievedSignal(sig);
-		}
+		std::string message = sharedBuffer +
+			signals.front().getTypeName() + " from " +
+			signals.front().getSenderName() + " to " +
+			signals.front().getRecieverName();
+		deliver(Signal(Signal::UI_MSG_DEBUG, moduleId, Signal::UI_MODULES,
+		               new sig::StringData(message)));
 #endif
 
 		/* /core/modules/exits needs special handling */
-		if (signals.front().getType() == "/core/module/exits") {
-			removeModule(signals.front().getSender());
+		if (signals.front().getType() == Signal::CORE_MODULE_EXITS) {
+			removeModule(signals.front().getSenderName());
 		} else {
-#if PPC_CORE_DEBUG_SIGNALS
-			it = matchingModules(signals.front().getReciever());
-#else
-			std::pair<Modules::iterator, Modules::iterator> it
-				= matchingModules(signals.front().getReciever());
-#endif
-			for (; it.first != it.second; ++it.first) {
-				it.first->second->recievedSignal(signals.front());
+			deliver(signals.front());
+		}
+	}
+}
+
+
+
+void Core::deliver(const Signal &sig) {
+	if (routesStale) {
+		buildRoutes();
+	}
+	if (sig.getType() >= routes.size()) {
+		return;
+	}
+
+	/* Modules are never removed while signal is being delivered and
+	   routes are not rebuilt till then so the list stays valid. */
+	const std::vector<Module*> &targets = routes[sig.getType()];
+	const unsigned reciever = sig.getReciever(), count = targets.size();
+	for (unsigned i = 0; i < count; ++i) {
+		if (targets[i]->isAddressedBy(reciever)) {
+			targets[i]->recievedSignal(sig);
+		}
+	}
+}
+
+
+void Core::buildRoutes() {
+	for (Routes::iterator it = routes.begin(); it != routes.end(); ++it) {
+		it->clear();
+	}
+
+	Modules::const_iterator it = modules.begin(), end = modules.end();
+	for (; it != end; ++it) {
+		const std::vector<unsigned> &types = it->second->subscriptions;
+		for (unsigned i = 0; i < types.size(); ++i) {
+			if (types[i] >= routes.size()) {
+				routes.resize(types[i] + 1);
 			}
+			routes[types[i]].push_back(it->second);
 		}
 	}
+	routesStale = false;
 }
 
 
@@ -273,24 +326,6 @@ Core::matchingModules(const std::string &reciever) {
 void Core::handleUnixSignals() {
 	int i = 1;
 
-	sigarr[0] -= sigarr[SIGALRM];
-	while (sigarr[SIGALRM] > 0) {
-		alarm(1);
-		sendSignal("/core/tick", "/");
-		--sigarr[SIGALRM];
-	}
-
-	if (sigarr[SIGTERM]) {
-		killModules("/");
-	}
-
-	if (sigarr[SIGCHLD]) {
-		do {
-			::wait(0);
-			--sigarr[0];
-		} while (--sigarr[SIGCHLD]);
-	}
-
 	while (sigarr[0] > 0) {
 		while (sigarr[i] == 0 && i < 32) ++i;
 		if (i == 32) {
@@ -299,14 +334,10 @@ void Core::handleUnixSignals() {
 			break;
 		}
 
-		int j = sigarr[i];
+		const int j = sigarr[i];
 		sigarr[0] -= j;
 		sigarr[i] = 0;
-		sprintf(sharedBuffer, "/core/sig/%d", i);
-		std::string sigType(sharedBuffer);
-		do {
-			sendSignal(sigType, "/");
-		} while (--j);
+		handleUnixSignal(i, j);
 	}
 
 	assert(sigarr[0] == 0);
@@ -314,6 +345,55 @@ void Core::handleUnixSignals() {
 }
 
 
+void Core::handleFD(int fd, unsigned events) {
+	(void)events;
+#ifdef __linux__
+	struct signalfd_siginfo info[16];
+	unsigned counts[32] = { 0 };
+	ssize_t ret;
+
+	/* Count signals first so each is handled once per batch. */
+	while ((ret = read(fd, info, sizeof info)) > 0) {
+		const unsigned n = ret / sizeof *info;
+		for (unsigned i = 0; i < n; ++i) {
+			if (info[i].ssi_signo < sizeof counts / sizeof *counts) {
+				++counts[info[i].ssi_signo];
+			}
+		}
+	}
+
+	for (unsigned i = 1; i < sizeof counts / sizeof *counts; ++i) {
+		if (counts[i]) {
+			handleUnixSignal(i, counts[i]);
+		}
+	}
+#else
+	(void)fd;
+#endif
+}
+
+
+void Core::handleUnixSignal(int signum, unsigned count) {
+	switch (signum) {
+	case SIGCHLD:
+		while (waitpid(-1, 0, WNOHANG) > 0) {
+			/* nothing */
+		}
+		return;
+
+	case SIGTERM:
+		killModules("/");
+		break;
+	}
+
+	if (signum > 0 && signum <= Signal::CORE_SIG_LAST - Signal::CORE_SIG) {
+		do {
+			sendSignal(Signal::CORE_SIG + signum, Signal::ALL_MODULES);
+		} while (--count);
+	}
+}
+
+
 
 bool Core::addModule(Module &module) {
 	if (module.moduleName.empty() || module.moduleName[0] != '/' ||
@@ -324,49 +404,49 @@ bool Core::addModule(Module &module) {
 	std::pair<Modules::iterator, bool> ret =
 		modules.insert(std::make_pair(module.moduleName, &module));
 	if (ret.second) {
+		routesStale = true;
 		ui_modules += module.isActiveUI();
 		module.dieDueTime = std::numeric_limits<unsigned long>::max();
 		module.prevToKill = module.nextToKill = 0;
 
-		sendSignal("/core/module/new", "/", module.moduleName);
+		sendSignal(Signal::CORE_MODULE_NEW, Signal::ALL_MODULES,
+		           module.moduleName);
 	}
 	return ret.second;
 }
 
 
 
-int Core::setFDSets(fd_set *rd, fd_set *wr, fd_set *ex) {
-	(void)rd; (void)wr; (void)ex;
-	return 0;
-}
-
-
-
-int Core::doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-                const fd_set *ex) {
-	(void)nfds; (void)rd; (void)wr; (void)ex;
-	return 0;
-}
-
-
-
 void Core::recievedSignal(const Signal &sig) {
-	/* Some modules are due to die? */
-	if (sig.getType() == "/core/tick") {
-		++Core::ticks;
-		while (nextToKill->dieDueTime <= Core::getTicks()) {
-			removeModule(nextToKill->moduleName);
-		}
-
+	switch (sig.getType()) {
 	/* Someone wants someone dead! */
-	} else if (sig.getType() == "/core/module/kill") {
+	case Signal::CORE_MODULE_KILL:
 		killModules(sig.getData<sig::StringData>()->data);
+		break;
 
 	/* Start a new module */
-	} else if (sig.getType() == "/core/module/start") {
+	case Signal::CORE_MODULE_START:
 		/* FIXME: TODO */
+		break;
+	}
+}
 
+
+
+void Core::handleTimer(Timer &timer) {
+	if (&timer != &tickTimer) {
+		return;
 	}
+
+	/* Some modules are due to die?  This is done here rather then
+	   when /core/tick is delivered since modules must not be
+	   removed while a signal is being delivered. */
+	++Core::ticks;
+	while (nextToKill->dieDueTime <= Core::getTicks()) {
+		removeModule(Signal::name(nextToKill->moduleId));
+	}
+
+	sendSignal(Signal::CORE_TICK, Signal::ALL_MODULES);
 }
 
 
@@ -378,7 +458,7 @@ void Core::killModules(const std::string &target) {
 
 	const unsigned long dueTime = Core::getTicks() + 60;
 
-	sendSignal("/core/module/quit", target);
+	sendSignal(Signal::CORE_MODULE_QUIT, Signal::intern(target));
 
 	for (; it.first != it.second; ++it.first) {
 		if (it.first->second->prevToKill) continue;
@@ -408,7 +488,8 @@ void Core::removeModule(const std::string &name) {
 	const bool active = it->second->isActiveUI();
 	delete it->second;
 	modules.erase(it);
-	sendSignal("/core/module/removed", "/", name);
+	routesStale = true;
+	sendSignal(Signal::CORE_MODULE_REMOVED, Signal::ALL_MODULES, name);
 
 	if (active && !--ui_modules) {
 		killModules("/");
@@ -20,14 +20,17 @@
 #define H_APPLICATION_HPP
 
 #include <string.h>
-#include <sys/select.h>
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include <limits>
+#include <vector>
 
 #include "shared-buffer.hpp"
 #include "signal.hpp"
+#include "poller.hpp"
+#include "timer.hpp"
 #include "vector-queue.hpp"
 
 
@@ -40,8 +43,11 @@ struct Core;
 
 /**
  * An abstract class representing single module.  Each module has its
- * name and can send signals to other modules.  Module can maintain
- * a list of file descriptors witch will be select()ed in core module.
+ * name and can send signals to other modules.  Module can register
+ * file descriptors in core module's Poller and its handleFD() method
+ * will be called when any of them becomes ready.  Module can also
+ * start timers in core module's TimerWheel and its handleTimer()
+ * method will be called when any of them expires.
  *
  * Module's name must be unique.  Names resamble an unix absolute path
  * name but only lower case letters, digits and hypens are allowed.
@@ -49,10 +55,13 @@ struct Core;
  * <tt>/net/<i>proto</i>/<i>id</i></tt> (where <i>proto</i> may be
  * only <tt>ppc</tt>) and <tt>/ui/<i>type</i>/<i>id</i></tt>.
  */
-struct Module {
+struct Module : public FDHandler, public TimerHandler {
 	/** Module's name, */
 	const std::string moduleName;
 
+	/** Module's name ID (see Signal::intern()). */
+	const unsigned moduleId;
+
 
 	/**
 	 * Initialises basic variables.
@@ -60,7 +69,10 @@ struct Module {
 	 * \param c core module.
 	 * \param name module's name.
 	 */
-	Module(Core &c, const std::string &name) : moduleName(name), core(c) { }
+	Module(Core &c, const std::string &name)
+		: moduleName(name), moduleId(Signal::intern(name)), core(c) {
+		internRecievers();
+	}
 
 	/**
 	 * Initialises basic variables.
@@ -70,7 +82,10 @@ struct Module {
 	 * \param seq    sequence number
 	 */
 	Module(Core &c, const std::string &prefix, unsigned long seq)
-		: moduleName(makeModuleName(prefix, seq)), core(c) { }
+		: moduleName(makeModuleName(prefix, seq)),
+		  moduleId(Signal::intern(moduleName)), core(c) {
+		internRecievers();
+	}
 
 
 	/** Destructor. */
@@ -78,46 +93,51 @@ struct Module {
 
 
 	/**
-	 * Sets bits in file descriptors sets to use in select().  Method
-	 * may not clear any bits in those sets.  If given condition for
-	 * a file descriptor is met doFDs() method will be called.
+	 * Called when file descriptor registered with watchFD() is
+	 * ready.  Default implementation does nothing.
 	 *
-	 * Method must return integer one greater then biggest file
-	 * descriptor number used in any set or zero if no bits were set.
-	 *
-	 * \param rd file descriptors to watch to see if characters become
-	 *           available for reading (more precisely, to see if
-	 *           a read will not block; in particular, a file
-	 *           descriptor is also ready on end-of-file).
-	 * \param wr file descriptors to watch to see if a write will not
-	 *           block.
-	 * \param ex file descriptors to watch for exceptions.
-	 * \return integer one greater then biggest file descriptor number
-	 *         used in any set or zero if no bits were set.
-	 */
-	virtual int setFDSets(fd_set *rd, fd_set *wr, fd_set *ex) = 0;
-
-	/**
-	 * Perferms operations on files in sets.  Note that set may
-	 * contain file descriptors module is not interested in.  Method
-	 * must return number of operations it took care of.
+	 * \param fd     file descriptor which is ready.
+	 * \param events combination of Poller::READ and Poller::WRITE
+	 *               flags.
+	 */
+	virtual void handleFD(int fd, unsigned events);
+
+	/**
+	 * Called when timer started with startTimer() expires.  Default
+	 * implementation does nothing.
 	 *
-	 * \param nfds number of bits set.
-	 * \param rd   file descriptors ready for reading.
-	 * \param wr   file descriptors ready for writtitg.
-	 * \param ex   file descriptors where exception occured.
-	 * \return number of operations it took care of.
+	 * \param timer timer which expired.
 	 */
-	virtual int doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-	                  const fd_set *ex) = 0;
+	virtual void handleTimer(Timer &timer);
 
 
 	/**
-	 * A signal has been delivered to module.
+	 * A signal has been delivered to module.  Only signals of types
+	 * module subscribed to with subscribe() are delivered.
 	 * \param sig delivered signal.
 	 */
 	virtual void recievedSignal(const Signal &sig) = 0;
 
+	/**
+	 * Returns \c true iff module subscribed to given signal type.
+	 * \param type signal's type ID.
+	 */
+	bool isSubscribed(unsigned type) const {
+		return std::binary_search(subscriptions.begin(),
+		                          subscriptions.end(), type);
+	}
+
+	/**
+	 * Returns \c true iff signal addressed to given reciever pattern
+	 * shall be delivered to this module, ie. if pattern is module's
+	 * name or a prefix of it ending with a slash.
+	 * \param reciever reciever pattern ID.
+	 */
+	bool isAddressedBy(unsigned reciever) const {
+		return std::binary_search(recievers.begin(), recievers.end(),
+		                          reciever);
+	}
+
 
 	/**
 	 * Returns \c true iff this module is to be considered an
@@ -148,16 +168,24 @@ protected:
 	/** Core module. */
 	Core &core;
 
+	/**
+	 * Subscribes to signals of given type.  Module will recieve only
+	 * signals of types it subscribed to (and which are addressed to
+	 * it).  This is usually called from module's constructor.
+	 *
+	 * \param type signal's type ID.
+	 */
+	inline void subscribe(unsigned type);
+
 	/**
 	 * Sends a signal.  Signal is added to core module's signal queue
 	 * and will be delivered later on.
 	 *
-	 * \param type     signal's type.
-	 * \param reciever signal's reciever.
+	 * \param type     signal's type ID.
+	 * \param reciever signal's reciever ID.
 	 * \param sigData  signal data.
 	 */
-	inline void sendSignal(const std::string &type,
-	                       const std::string &reciever,
+	inline void sendSignal(unsigned type, unsigned reciever,
 	                       Signal::Data *sigData = 0);
 
 	/**
@@ -165,11 +193,11 @@ protected:
 	 * and will be delivered later on.  Signal's argument will be an
 	 * sig::StringData object with \a str as it's data.
 	 *
-	 * \param type     signal's type.
-	 * \param reciever signal's reciever.
+	 * \param type     signal's type ID.
+	 * \param reciever signal's reciever ID.
 	 * \param str      signal's argument data.
 	 */
-	void sendSignal(const std::string &type, const std::string &reciever,
+	void sendSignal(unsigned type, unsigned reciever,
 	                const std::string &str) {
 		sendSignal(type, reciever, new sig::StringData(str));
 	}
@@ -178,12 +206,68 @@ protected:
 	 * Sends a signal.  Signal is added to core module's signal queue
 	 * and will be delivered later on.
 	 *
-	 * \param type     signal's type.
-	 * \param reciever signal's reciever.
+	 * \param type     signal's type ID.
+	 * \param reciever signal's reciever ID.
 	 * \param sig      signal to copy data from.
 	 */
-	inline void sendSignal(const std::string &type,
-	                       const std::string &reciever, const Signal &sig);
+	inline void sendSignal(unsigned type, unsigned reciever,
+	                       const Signal &sig);
+
+	/**
+	 * Starts watching file descriptor.  When descriptor becomes ready
+	 * handleFD() will be called.  Module must call unwatchFD() before
+	 * it closes the descriptor.
+	 *
+	 * \param fd     file descriptor.
+	 * \param events combination of Poller::READ and Poller::WRITE
+	 *               flags.
+	 * \throw IOException if error occured.
+	 */
+	inline void watchFD(int fd, unsigned events);
+
+	/**
+	 * Changes events file descriptor is watched for.  This is cheap
+	 * if events do not change.
+	 *
+	 * \param fd     file descriptor.
+	 * \param events combination of Poller::READ and Poller::WRITE
+	 *               flags.
+	 * \throw IOException if error occured.
+	 */
+	inline void setFDEvents(int fd, unsigned events);
+
+	/**
+	 * Stops watching file descriptor.
+	 * \param fd file descriptor.
+	 */
+	inline void unwatchFD(int fd);
+
+	/**
+	 * Starts watching file descriptor object.  Unlike watchFD() the
+	 * object maintains its events by itself (see
+	 * FileDescriptor::watch()) and stops being watched when it is
+	 * destroyed.  handleFD() will be called with \a fd.fd when
+	 * descriptor becomes ready.
+	 *
+	 * \param fd     file descriptor object.
+	 * \param events combination of Poller::READ and Poller::WRITE
+	 *               flags.
+	 * \throw IOException if error occured.
+	 */
+	inline void watch(FileDescriptor &fd, unsigned events);
+
+	/**
+	 * Starts (or restarts) timer.  When timer expires handleTimer()
+	 * will be called.  Timer is stopped with Timer::stop() or when it
+	 * is destroyed.
+	 *
+	 * \param timer  timer to start.
+	 * \param delay  number of milliseconds after which timer expires.
+	 * \param period if non-zero timer is periodic and expires every
+	 *               \a period milliseconds after first expiration.
+	 */
+	inline void startTimer(Timer &timer, unsigned long delay,
+	                       unsigned long period = 0);
 
 	/** Returns list of modules. */
 	inline const Modules getModules() const;
@@ -201,6 +285,19 @@ private:
 	/** Previous element in "kill" list. */
 	Module *prevToKill;
 
+	/** Sorted list of signal types module subscribed to. */
+	std::vector<unsigned> subscriptions;
+
+	/**
+	 * Sorted list of IDs of reciever patterns matching module's
+	 * name (see isAddressedBy()).
+	 */
+	std::vector<unsigned> recievers;
+
+
+	/** Fills recievers list. */
+	void internRecievers();
+
 	/* Core needs to modify dieDueTime and nextToKill. */
 	friend struct Core;
 };
@@ -208,7 +305,7 @@ private:
 
 
 /**
- * Core module that select()s file descriptors, deliveres signals and
+ * Core module that polls file descriptors, deliveres signals and
  * maintains madules list.
  */
 struct Core : protected Module {
@@ -218,9 +315,17 @@ struct Core : protected Module {
 	 * \param cfg  application configuration.
 	 */
 	Core(Config &cfg)
-		: Module(*this, Core::coreName), config(cfg), ui_modules(0) {
+		: Module(*this, Core::coreName), poller(Poller::create()),
+		  signalFD(-1), routesStale(true), config(cfg), ui_modules(0) {
 		modules[moduleName] = prevToKill = nextToKill = this;
 		dieDueTime = std::numeric_limits<unsigned long>::max();
+		subscribe(Signal::CORE_MODULE_KILL);
+		subscribe(Signal::CORE_MODULE_START);
+	}
+
+	/** Destructor. */
+	~Core() {
+		delete poller;
 	}
 
 
@@ -262,20 +367,23 @@ struct Core : protected Module {
 
 
 protected:
-	virtual int setFDSets(fd_set *rd, fd_set *wr, fd_set *ex);
-	virtual int doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-	                  const fd_set *ex);
 	virtual void recievedSignal(const Signal &sig);
+	virtual void handleFD(int fd, unsigned events);
+	virtual void handleTimer(Timer &timer);
 
 	/* Overwritten just to optimize for speed -- no need to reference
 	   through core field */
-	void sendSignal(const std::string &type, const std::string &reciever,
-                        Signal::Data *sigData = 0) {
-		signals.push(Signal(type, moduleName, reciever, sigData));
+	void sendSignal(unsigned type, unsigned reciever,
+	                Signal::Data *sigData = 0) {
+		signals.emplace().assign(type, moduleId, reciever, sigData);
 	}
-	void sendSignal(const std::string &type, const std::string &reciever,
-                        const Signal &sig) {
-		signals.push(Signal(type, moduleName, reciever, sig));
+	void sendSignal(unsigned type, unsigned reciever,
+	                const std::string &str) {
+		sendSignal(type, reciever, new sig::StringData(str));
+	}
+	void sendSignal(unsigned type, unsigned reciever, const Signal &sig) {
+		signals.emplace().assign(type, moduleId, reciever,
+		                         sig.getDataPointer());
 	}
 
 	const Modules getModules() const {
@@ -290,12 +398,43 @@ private:
 	/** Signals queue. */
 	typedef std::queue<Signal, std::vector<Signal> > Queue;
 
+	/**
+	 * Routing table mapping signal's type ID (used as index) to list
+	 * of modules subscribed to that type.
+	 */
+	typedef std::vector<std::vector<Module*> > Routes;
+
 	/** Modules list. */
 	Modules modules;
 
+	/** File descriptors readiness notification backend. */
+	Poller *const poller;
+
+	/** Timers. */
+	TimerWheel timers;
+
+	/** Timer sending \c /core/tick signal every second. */
+	Timer tickTimer;
+
+	/**
+	 * A signalfd(2) descriptor unix signals are read from or -1 if
+	 * signals are caught by a signal handler.
+	 */
+	int signalFD;
+
 	/** Signals queue. */
 	Queue signals;
 
+	/** Routing table, see buildRoutes(). */
+	Routes routes;
+
+	/**
+	 * Whether routing table is out of date, ie. whether module has
+	 * been added or removed or subscribed to a new signal type since
+	 * it was built.
+	 */
+	bool routesStale;
+
 	/** Application configuration. */
 	Config &config;
 
@@ -309,9 +448,22 @@ private:
 	/** Delivers signals to modules. */
 	void deliverSignals();
 
-	/** Handles recieved unix signals. */
+	/**
+	 * Handles unix signals caught by signal handler.  Used only if
+	 * signalfd(2) is not available.
+	 */
 	void handleUnixSignals();
 
+	/**
+	 * Handles a batch of unix signals with the same number.  Reaps
+	 * children on \c SIGCHLD, starts killing modules on \c SIGTERM
+	 * (once per batch) and sends a \c /core/sig/num signal for each
+	 * occurrence (except for \c SIGCHLD).
+	 * \param signum signal number.
+	 * \param count  number of times signal was delivered, non-zero.
+	 */
+	void handleUnixSignal(int signum, unsigned count);
+
 	/**
 	 * Does the job when \c /core/module/kill signal is recieved.
 	 * \param target pattern of modules to kill
@@ -337,6 +489,23 @@ private:
 	std::pair<Modules::iterator, Modules::iterator>
 	matchingModules(const std::string &reciever);
 
+	/**
+	 * Rebuilds routing table from modules' subscriptions.  Modules
+	 * are listed in order of their names.
+	 */
+	void buildRoutes();
+
+	/**
+	 * Delivers signal to all modules matching its reciever pattern
+	 * which subscribed to its type.  If routing table is stale it is
+	 * rebuilt first; it is never rebuilt while a signal is being
+	 * delivered so modules may subscribe and be added while handling
+	 * a signal.
+	 *
+	 * \param sig signal to deliver.
+	 */
+	void deliver(const Signal &sig);
+
 
 	friend struct Module;
 };
@@ -346,13 +515,40 @@ private:
    Core structure thus it will call Core's specific method which in
    turn does what we want. */
 
-void Module::sendSignal(const std::string &type, const std::string &reciever,
+void Module::sendSignal(unsigned type, unsigned reciever,
                         Signal::Data *sigData) {
-	core.signals.push(Signal(type, moduleName, reciever, sigData));
+	core.signals.emplace().assign(type, moduleId, reciever, sigData);
 }
-void Module::sendSignal(const std::string &type, const std::string &reciever,
+void Module::sendSignal(unsigned type, unsigned reciever,
                         const Signal &sig) {
-	core.signals.push(Signal(type, moduleName, reciever, sig));
+	core.signals.emplace().assign(type, moduleId, reciever,
+	                              sig.getDataPointer());
+}
+
+void Module::subscribe(unsigned type) {
+	std::vector<unsigned>::iterator it =
+		std::lower_bound(subscriptions.begin(), subscriptions.end(), type);
+	if (it == subscriptions.end() || *it != type) {
+		subscriptions.insert(it, type);
+		core.routesStale = true;
+	}
+}
+
+void Module::watchFD(int fd, unsigned events) {
+	core.poller->add(fd, events, *this);
+}
+void Module::setFDEvents(int fd, unsigned events) {
+	core.poller->modify(fd, events);
+}
+void Module::unwatchFD(int fd) {
+	core.poller->remove(fd);
+}
+void Module::watch(FileDescriptor &fd, unsigned events) {
+	fd.watch(*core.poller, *this, events);
+}
+void Module::startTimer(Timer &timer, unsigned long delay,
+                        unsigned long period) {
+	core.timers.start(timer, *this, delay, period);
 }
 
 const Module::Modules Module::getModules() const {
@@ -30,6 +30,10 @@
 namespace ppc {
 
 
+struct Poller;
+struct FDHandler;
+
+
 /**
  * An exception in input/output operations.
  */
@@ -71,9 +75,13 @@ struct FileDescriptor {
 	const int fd;
 
 	/**
-	 * Closes file descriptor.
+	 * Closes file descriptor.  If descriptor is watched by a Poller
+	 * it is unregistered first.
 	 */
 	~FileDescriptor() {
+		if (poller) {
+			unwatch();
+		}
 		close(fd);
 	}
 
@@ -99,6 +107,46 @@ struct FileDescriptor {
 		setNonBlocking(fd);
 	}
 
+
+	/**
+	 * Registers descriptor in a Poller.  From now on descriptor
+	 * itself keeps its events up to date (ie. sockets watch for
+	 * writing only when they have data to send) and it is
+	 * unregistered automatically when object is destroyed.
+	 * Descriptor must not be already watched.
+	 *
+	 * \param p       poller to register descriptor in.
+	 * \param handler object to notify when descriptor is ready.
+	 * \param events  combination of Poller::READ and Poller::WRITE
+	 *                flags.
+	 * \throw IOException if error occured.
+	 */
+	void watch(Poller &p, FDHandler &handler, unsigned events);
+
+	/** Unregisters descriptor from a Poller it is watched by if any. */
+	void unwatch();
+
+	/** Returns \c true iff descriptor is watched by a Poller. */
+	bool isWatched() const { return poller; }
+
+	/**
+	 * Adds events descriptor is watched for.  Does nothing if
+	 * descriptor is not watched.
+	 * \param events combination of Poller::READ and Poller::WRITE
+	 *               flags.
+	 * \throw IOException if error occured.
+	 */
+	void addEvents(unsigned events);
+
+	/**
+	 * Removes events descriptor is watched for.  Does nothing if
+	 * descriptor is not watched.
+	 * \param events combination of Poller::READ and Poller::WRITE
+	 *               flags.
+	 * \throw IOException if error occured.
+	 */
+	void removeEvents(unsigned events);
+
 protected:
 	/**
 	 * Constructs object.
@@ -106,11 +154,15 @@ protected:
 	 * \param nonBlocking if \c true a \c O_NONBLOCK flag is set on
 	 *        this descriptor.
 	 */
-	FileDescriptor(int f, bool nonBlocking = true) : fd(f) {
+	FileDescriptor(int f, bool nonBlocking = true) : fd(f), poller(0) {
 		if (nonBlocking) {
 			setNonBlocking(f);
 		}
 	}
+
+private:
+	/** Poller descriptor is watched by or \c NULL. */
+	Poller *poller;
 };
 
 
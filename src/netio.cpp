@@ -53,56 +53,144 @@ int TCPSocket::connect(Address addr, bool &inProgress) {
 
 
 std::string TCPSocket::read() {
+	return std::string(sharedBuffer, read(sharedBuffer, sizeof sharedBuffer));
+}
+
+
+std::string::size_type TCPSocket::read(char *buf, std::string::size_type len) {
 	int numbytes;
 
-	while ((numbytes = recv(fd, sharedBuffer, sizeof sharedBuffer, 0)) <= 0) {
+	while ((numbytes = recv(fd, buf, len, 0)) <= 0) {
 		if (numbytes == 0) {
 			flags |= 1;
-			return std::string();
+			removeEvents(Poller::READ);
+			return 0;
 		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-			return std::string();
+			return 0;
 		} else if (errno != EINTR) {
 			throw IOException("recv: ", errno);
 		}
 	}
 
-	return std::string(sharedBuffer, numbytes);
+	return numbytes;
+}
+
+
+void TCPSocket::push(const std::string &str) {
+	if (str.empty()) {
+		return;
+	}
+	if (owned && owned->data.size() < PPC_TCP_SEGMENT_SIZE) {
+		owned->data += str;
+	} else {
+		owned = new Buffer(str);
+		segments.push(owned);
+	}
+	addEvents(Poller::WRITE);
+}
+
+
+void TCPSocket::push(const shared_obj<const Buffer> &buffer) {
+	if (buffer->data.empty()) {
+		return;
+	}
+	owned = 0;
+	segments.push(buffer);
+	addEvents(Poller::WRITE);
+}
+
+
+std::string &TCPSocket::pushInPlace(std::string::size_type len) {
+	if (!owned || owned->data.size() >= PPC_TCP_SEGMENT_SIZE) {
+		owned = new Buffer();
+		segments.push(owned);
+	}
+	owned->data.reserve(owned->data.size() + len);
+	addEvents(Poller::WRITE);
+	return owned->data;
+}
+
+
+void TCPSocket::consume(std::string::size_type len) {
+	while (len) {
+		const std::string::size_type left =
+			segments.front()->data.size() - offset;
+		if (len < left) {
+			offset += len;
+			return;
+		}
+
+		if (segments.front().get() == owned) {
+			owned = 0;
+		}
+		segments.front() = (Buffer*)0;
+		segments.pop();
+		offset = 0;
+		len -= left;
+	}
 }
 
 
 void TCPSocket::write() {
-	int pos, len = data.length(), ret;
+	int ret;
 
 	if (flags & 2) {
-		socklen_t optlen = sizeof pos;
-		ret = getsockopt(fd, SOL_SOCKET, SO_ERROR, &pos, &optlen);
+		int error;
+		socklen_t optlen = sizeof error;
+		ret = getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &optlen);
 		if (ret < 0) {
 			throw IOException("getsockopt: ", errno);
 		}
-		if (pos) {
-			throw IOException("connect: ", pos);
+		if (error) {
+			throw IOException("connect: ", error);
 		}
 		flags &= ~2;
 	}
 
-	if (!len) {
-		return;
-	}
+	while (!segments.empty()) {
+		struct iovec iovecs[PPC_TCP_IOVECS];
+		struct msghdr msg;
+		const unsigned size = segments.size();
+		unsigned count = 0;
+
+		/* Skip empty segments (pushInPlace() may leave one) since
+		   nothing would ever consume a zero-length iovec. */
+		for (unsigned i = 0; i < size && count < PPC_TCP_IOVECS; ++i) {
+			const std::string &data = segments[i]->data;
+			const std::string::size_type skip = i ? 0 : offset;
+			if (data.size() > skip) {
+				iovecs[count].iov_base =
+					const_cast<char*>(data.data()) + skip;
+				iovecs[count].iov_len = data.size() - skip;
+				++count;
+			}
+		}
 
-	pos = 0;
-	const char *const buf = data.data();
-	while (len > 0) {
-		ret = send(fd, buf + pos, len, MSG_NOSIGNAL);
+		if (!count) {
+			/* Only empty segments are left. */
+			while (!segments.empty()) {
+				segments.front() = (Buffer*)0;
+				segments.pop();
+			}
+			owned = 0;
+			offset = 0;
+			break;
+		}
+
+		memset(&msg, 0, sizeof msg);
+		msg.msg_iov = iovecs;
+		msg.msg_iovlen = count;
+
+		ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
 		if (ret > 0) {
-			pos += ret;
-			len -= ret;
+			consume(ret);
 		} else if (!ret || errno == EAGAIN || errno == EWOULDBLOCK) {
-			break;
+			return;
 		} else if (errno != EINTR) {
 			throw IOException("send: ", errno);
 		}
 	}
-	data.erase(0, pos);
+	removeEvents(Poller::WRITE);
 }
 
 
@@ -240,30 +328,127 @@ std::string UDPSocket::read(Address &addr) {
 }
 
 
-void UDPSocket::write() {
+unsigned UDPSocket::receive() {
+#ifdef __linux__
+	struct mmsghdr msgs[PPC_UDP_BATCH];
+	struct iovec iovecs[PPC_UDP_BATCH];
+	struct sockaddr_in addrs[PPC_UDP_BATCH];
+	int count;
+
+	memset(msgs, 0, sizeof msgs);
+	for (unsigned i = 0; i < PPC_UDP_BATCH; ++i) {
+		iovecs[i].iov_base = buffers[i];
+		iovecs[i].iov_len = sizeof buffers[i];
+		msgs[i].msg_hdr.msg_iov = iovecs + i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = addrs + i;
+		msgs[i].msg_hdr.msg_namelen = sizeof addrs[i];
+	}
+
+	while ((count = recvmmsg(fd, msgs, PPC_UDP_BATCH, 0, 0)) < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		} else if (errno == ENOSYS) {
+			return receiveEach();
+		} else if (errno != EINTR) {
+			throw IOException("recvmmsg: ", errno);
+		}
+	}
+
+	for (int i = 0; i < count; ++i) {
+		datagrams[i].data = buffers[i];
+		datagrams[i].length = msgs[i].msg_len;
+		datagrams[i].address = addrs[i];
+	}
+	return count;
+#else
+	return receiveEach();
+#endif
+}
+
+
+unsigned UDPSocket::receiveEach() {
+	unsigned count = 0;
+
+	while (count < PPC_UDP_BATCH) {
+		struct sockaddr_in sockaddr;
+		socklen_t size = sizeof sockaddr;
+		const int numbytes =
+			recvfrom(fd, buffers[count], sizeof buffers[count], 0,
+			         (struct sockaddr*)&sockaddr, &size);
+		if (numbytes >= 0) {
+			datagrams[count].data = buffers[count];
+			datagrams[count].length = numbytes;
+			datagrams[count].address = sockaddr;
+			++count;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		} else if (errno != EINTR) {
+			throw IOException("recvfrom: ", errno);
+		}
+	}
+
+	return count;
+}
+
+
+int UDPSocket::send() {
+#ifdef __linux__
+	struct mmsghdr msgs[PPC_UDP_BATCH];
+	struct iovec iovecs[PPC_UDP_BATCH];
+	struct sockaddr_in addrs[PPC_UDP_BATCH];
+	const unsigned count = queue.size() < PPC_UDP_BATCH
+		? queue.size() : PPC_UDP_BATCH;
+
+	memset(msgs, 0, count * sizeof *msgs);
+	for (unsigned i = 0; i < count; ++i) {
+		const Outgoing &datagram = queue[i];
+		const std::string &data = datagram.first->data;
+		datagram.second.toSockaddr(addrs[i]);
+		iovecs[i].iov_base = const_cast<char*>(data.data());
+		iovecs[i].iov_len = data.size();
+		msgs[i].msg_hdr.msg_iov = iovecs + i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = addrs + i;
+		msgs[i].msg_hdr.msg_namelen = sizeof addrs[i];
+	}
+
+	const int sent = sendmmsg(fd, msgs, count, 0);
+	if (sent >= 0 || errno != ENOSYS) {
+		return sent;
+	}
+#endif
+
 	struct sockaddr_in sockaddr;
+	const Outgoing &datagram = queue.front();
+	const std::string &data = datagram.first->data;
+	datagram.second.toSockaddr(sockaddr);
+	const int ret = sendto(fd, data.data(), data.size(), 0,
+	                       (struct sockaddr*)&sockaddr, sizeof sockaddr);
+	return ret < 0 ? ret : ret > 0;
+}
 
-	while (!queue.empty()) {
-		std::pair<std::string, Address> &pair = queue.front();
-		int ret;
 
-		pair.second.toSockaddr(sockaddr);
-		ret = sendto(fd, pair.first.data(), pair.first.size(), 0,
-		             (struct sockaddr*)&sockaddr, sizeof sockaddr);
+void UDPSocket::write() {
+	while (!queue.empty()) {
+		int ret = send();
 		if (ret > 0) {
-			/* ok, we sent something -- we don't really know if it was
-			   a whole datagram but lets hope it was */
-			queue.pop();
+			/* ok, we sent something -- we don't really know if those
+			   were whole datagrams but lets hope they were */
+			do {
+				pop();
+			} while (--ret);
 		} else if (ret == 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
 			return;
 		} else if (errno == EMSGSIZE) {
 			/* message too long -- so what can we do about it? */
-			queue.pop();
+			pop();
 		} else if (errno != EINTR) {
-			queue.pop();
+			pop();
 			throw IOException("sendto: ", errno);
 		}
 	}
+	removeEvents(Poller::WRITE);
 }
 
 }
@@ -30,7 +30,32 @@
 
 #include "vector-queue.hpp"
 #include "shared-buffer.hpp"
+#include "shared-obj.hpp"
+#include "pool.hpp"
 #include "io.hpp"
+#include "poller.hpp"
+
+
+/**
+ * Maximal number of datagrams UDPSocket recieves or sends with
+ * a single system call.
+ */
+#define PPC_UDP_BATCH          16
+
+/** Size of buffer for a single datagram recieved by UDPSocket. */
+#define PPC_UDP_BUFFER_SIZE  1024
+
+/**
+ * Maximal number of buffer segments TCPSocket sends with a single
+ * system call.
+ */
+#define PPC_TCP_IOVECS         16
+
+/**
+ * Size up to which strings pushed to TCPSocket are appended to the
+ * last segment instead of creating a new one.
+ */
+#define PPC_TCP_SEGMENT_SIZE 4096
 
 
 namespace ppc {
@@ -273,7 +298,7 @@ struct Address {
 	 * Fills a sockaddr_in structure.
 	 * \param addr sockaddr_in structure to fill in.
 	 */
-	void toSockaddr(struct sockaddr_in &addr) {
+	void toSockaddr(struct sockaddr_in &addr) const {
 		addr.sin_family = AF_INET;
 		addr.sin_port = port.network();
 		addr.sin_addr.s_addr = ip.network();
@@ -320,6 +345,25 @@ protected:
 
 
 
+/**
+ * A reference counted chunk of data to send.  The same buffer may be
+ * pushed to many TCPSocket objects without copying its contents.
+ */
+struct Buffer : public shared_obj_base {
+	/**
+	 * Sets buffer's contents.
+	 * \param str buffer's contents.
+	 */
+	explicit Buffer(const std::string &str = std::string()) : data(str) { }
+
+	/** Buffer's contents. */
+	std::string data;
+
+	PPC_POOL_OPERATORS(Buffer)
+};
+
+
+
 /** A TCP socket. */
 struct TCPSocket : public Socket {
 	/**
@@ -332,15 +376,39 @@ struct TCPSocket : public Socket {
 	 */
 	explicit TCPSocket(Address addr, bool dummy = false) :
 		/* dirty hack -- dummy will be set to value of inProgress */
-		Socket(connect(addr, dummy), addr, false) {
+		Socket(connect(addr, dummy), addr, false), offset(0), owned(0) {
 		flags = dummy ? 2 : 0;
 	}
 
 	/**
-	 * Pushes data to buffer to send it later on.
+	 * Pushes data to buffer to send it later on.  If socket is
+	 * watched by a Poller it starts being watched for writing.
 	 * \param str string to append to buffer.
+	 * \throw IOException if error occured.
+	 */
+	void push(const std::string &str);
+
+	/**
+	 * Pushes shared buffer to send it later on.  Buffer is not copied
+	 * so it must not be modified after it is pushed.  If socket is
+	 * watched by a Poller it starts being watched for writing.
+	 * \param buffer buffer to send.
+	 * \throw IOException if error occured.
+	 */
+	void push(const shared_obj<const Buffer> &buffer);
+
+	/**
+	 * Returns string data to send may be appended to directly.  Data
+	 * is appended to the last segment if it is ours and not full yet
+	 * or to a new segment otherwise.  Space for \a len bytes is
+	 * reserved.  Caller must append at least one byte before calling
+	 * any other method.  If socket is watched by a Poller it starts
+	 * being watched for writing.
+	 * \param len number of bytes caller is going to append.
+	 * \return string to append data to.
+	 * \throw IOException if error occured.
 	 */
-	void push(const std::string &str) { data += str; }
+	std::string &pushInPlace(std::string::size_type len);
 
 	/** Returns whether there is any data to send. */
 	bool hasDataToWrite() {
@@ -348,7 +416,7 @@ struct TCPSocket : public Socket {
 		   data to write but anyhow we need to poll descriptor for
 		   writing to get error code when connection is established or
 		   not. */
-		return (flags & 2) || !data.empty();
+		return (flags & 2) || !segments.empty();
 	}
 
 	/**
@@ -359,11 +427,26 @@ struct TCPSocket : public Socket {
 	 */
 	std::string read();
 
+	/**
+	 * Reads data from socket into given buffer.  This method must not
+	 * block!  If there is no data ready to be read or end of file was
+	 * reached (in which case isEOF() returns \c true) method shall
+	 * return zero.
+	 *
+	 * \param buf buffer to read data into.
+	 * \param len buffer's size.
+	 * \return number of read bytes.
+	 * \throw IOException if error occured.
+	 */
+	std::string::size_type read(char *buf, std::string::size_type len);
+
 	/**
 	 * Writes buffered data to socket.  This method must not block!
 	 * It should write us much data as it can without blocking.  It
 	 * shall return when there is no more data pending to be sent or
-	 * write operation would block.
+	 * write operation would block.  When all data has been sent
+	 * socket stops being watched for writing.  Up to \c
+	 * PPC_TCP_IOVECS segments are sent with a single system call.
 	 *
 	 * \throw IOException if error occured.
 	 */
@@ -376,12 +459,33 @@ struct TCPSocket : public Socket {
 
 
 private:
-	/** Buffered data to send. */
-	std::string data;
+	/** Queue of buffer segments to send. */
+	typedef std::queue< shared_obj<const Buffer>,
+	                    std::vector< shared_obj<const Buffer> > > Segments;
+
+	/** Segments with buffered data to send. */
+	Segments segments;
+
+	/** Number of already sent bytes of the first segment. */
+	std::string::size_type offset;
+
+	/**
+	 * The last segment if it was created by push(const std::string&)
+	 * and thus is not shared and can be appended to; \c NULL
+	 * otherwise.
+	 */
+	Buffer *owned;
 
 	/** Socket flags. */
 	unsigned char flags;
 
+	/**
+	 * Removes given number of bytes from the beginning of buffered
+	 * data.
+	 * \param len number of bytes to remove.
+	 */
+	void consume(std::string::size_type len);
+
 	/**
 	 * Creates TCP socket and connects to given address.
 	 * \param addr address to connected to.
@@ -402,7 +506,7 @@ private:
 	 *        this descriptor.
 	 */
 	TCPSocket(int sock, Address addr, bool nonBlocking = true) :
-		Socket(sock, addr, nonBlocking), flags(0) { }
+		Socket(sock, addr, nonBlocking), offset(0), owned(0), flags(0) { }
 
 	/* TCPListeningSocket needs to create TCPSocket objects when it
 	   accepts connection */
@@ -473,17 +577,86 @@ struct UDPSocket : public Socket {
 
 
 	/**
-	 * Pushes data to buffer to send it later on.
+	 * Pushes data to buffer to send it later on.  If socket is
+	 * watched by a Poller it starts being watched for writing.
 	 * \param str string to append to buffer.
 	 * \param addr address to send data to.
+	 * \throw IOException if error occured.
 	 */
 	void push(const std::string &str, Address addr) {
-		queue.push(std::pair<std::string, Address>(str, addr));
+		push(shared_obj<const Buffer>(new Buffer(str)), addr);
+	}
+
+	/**
+	 * Pushes shared buffer to send it later on as a single datagram.
+	 * Buffer is not copied so it must not be modified after it is
+	 * pushed.  If socket is watched by a Poller it starts being
+	 * watched for writing.
+	 * \param buffer buffer to send.
+	 * \param addr   address to send data to.
+	 * \throw IOException if error occured.
+	 */
+	void push(const shared_obj<const Buffer> &buffer, Address addr) {
+		Outgoing &datagram = queue.emplace();
+		datagram.first = buffer;
+		datagram.second = addr;
+		addEvents(Poller::WRITE);
+	}
+
+	/**
+	 * Adds a new datagram to the queue and returns string its
+	 * payload may be written into directly.  Space for \a len bytes
+	 * is reserved.  If socket is watched by a Poller it starts being
+	 * watched for writing.
+	 * \param addr address to send data to.
+	 * \param len  number of bytes caller is going to write.
+	 * \return string to append datagram's payload to.
+	 * \throw IOException if error occured.
+	 */
+	std::string &pushInPlace(Address addr, std::string::size_type len) {
+		Buffer *const buffer = new Buffer();
+		buffer->data.reserve(len);
+		push(shared_obj<const Buffer>(buffer), addr);
+		return buffer->data;
 	}
 
 	/** Returns whether there is any data to send. */
 	bool hasDataToWrite() { return !queue.empty(); }
 
+
+	/** A datagram recieved by receive(). */
+	struct Datagram {
+		/** Datagram's payload. */
+		const char *data;
+		/** Payload's length. */
+		std::string::size_type length;
+		/** Address datagram was recieved from. */
+		Address address;
+	};
+
+	/**
+	 * Recieves up to \c PPC_UDP_BATCH datagrams with a single system
+	 * call (if system supports \c recvmmsg()).  Recieved datagrams
+	 * can be accessed with datagram() method and are valid till next
+	 * call to receive() or read().  This method must not block!  If
+	 * it returns less then \c PPC_UDP_BATCH datagrams there is no more
+	 * data pending.  Datagrams longer then \c PPC_UDP_BUFFER_SIZE are
+	 * truncated.
+	 *
+	 * \return number of recieved datagrams.
+	 * \throw IOException if error occured.
+	 */
+	unsigned receive();
+
+	/**
+	 * Returns datagram recieved by the last call to receive().
+	 * \param i datagram's index, less then value returned by
+	 *          receive().
+	 */
+	const Datagram &datagram(unsigned i) const {
+		return datagrams[i];
+	}
+
 	/**
 	 * Reads data from socket.  This method must not block!  If there
 	 * is no data ready to be read method shall return empty string.
@@ -498,7 +671,10 @@ struct UDPSocket : public Socket {
 	 * Writes buffered data to socket.  This method must not block!
 	 * It should write us much data as it can without blocking.  It
 	 * shall return when there is no more data pending to be sent or
-	 * write operation would block.
+	 * write operation would block.  When queue has been emptied
+	 * socket stops being watched for writing.  Datagrams are sent in
+	 * batches of up to \c PPC_UDP_BATCH datagrams.  Datagrams which
+	 * are too long are silently dropped.
 	 *
 	 * \throw IOException if error occured.
 	 */
@@ -506,9 +682,47 @@ struct UDPSocket : public Socket {
 
 
 private:
+	/** Datagram waiting to be sent and its destination. */
+	typedef std::pair<shared_obj<const Buffer>, Address> Outgoing;
+
 	/** Queue of datagrams to send. */
-	std::queue< std::pair<std::string, Address>,
-	            std::vector< std::pair<std::string, Address> > > queue;
+	std::queue< Outgoing, std::vector<Outgoing> > queue;
+
+	/** Datagrams recieved by the last call to receive(). */
+	Datagram datagrams[PPC_UDP_BATCH];
+
+	/** Buffers datagrams are recieved into. */
+	char buffers[PPC_UDP_BATCH][PPC_UDP_BUFFER_SIZE];
+
+	/**
+	 * Recieves up to \c PPC_UDP_BATCH datagrams calling \c recvfrom()
+	 * for each of them.  Used when \c recvmmsg() is not available.
+	 * \return number of recieved datagrams.
+	 * \throw IOException if error occured.
+	 */
+	unsigned receiveEach();
+
+	/**
+	 * Sends datagrams from the head of the queue.  If system supports
+	 * \c sendmmsg() up to \c PPC_UDP_BATCH datagrams are sent with
+	 * a single system call, otherwise only the first one is sent.
+	 * Datagrams are not removed from queue.  If sending of a datagram
+	 * fails datagrams after it are not sent and error is reported
+	 * only if it was the first datagram.
+	 *
+	 * \return number of sent datagrams or -1 if error occured (\c
+	 *         errno is set apropriately).
+	 */
+	int send();
+
+	/**
+	 * Removes datagram from the head of the queue releasing its
+	 * buffer.
+	 */
+	void pop() {
+		queue.front().first = (Buffer*)0;
+		queue.pop();
+	}
 
 
 	/**
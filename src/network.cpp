@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include "network.hpp"
+#include "config.hpp"
 #include "ppcp-parser.hpp"
 #include "ppcp-packets.hpp"
 
@@ -73,6 +74,39 @@ struct NetworkConnection;
 
 
 
+/**
+ * List of users without any connections ordered by the moment of
+ * their last activity (least recently active first).  Users are
+ * appended when they are accessed so the order is maintained for
+ * free and expiring users only requires looking at the head of the
+ * list.  There are two such lists, one for users with offline state
+ * and one for all other users, since they expire after different
+ * time.
+ */
+struct UserExpiryList {
+	/** Constructor. */
+	UserExpiryList() : first(0), last(0) { }
+
+	/** Least recently active user or \c NULL. */
+	NetworkUser *first;
+	/** Most recently active user or \c NULL. */
+	NetworkUser *last;
+
+	/**
+	 * Appends user at the end of the list.
+	 * \param user user to append, must not be on any list.
+	 */
+	inline void push(NetworkUser &user);
+
+	/**
+	 * Removes user from the list.
+	 * \param user user to remove, must be on this list.
+	 */
+	inline void remove(NetworkUser &user);
+};
+
+
+
 /**
  * Specialisation of User class used to store additional attributes.
  * Network object has shared_obj which points to sig::UsersListData
@@ -90,35 +124,56 @@ struct NetworkUser : public User {
 	/**
 	 * Initialises User object.
 	 *
+	 * \param e  a pair of expiry lists user will be kept on, first
+	 *           for online and second for offline users.
 	 * \param i  user's ID -- nick name, IP address pair
 	 * \param n  user's display name or empty string.
 	 * \param st user's status.
 	 * \throw InvalidNick if \a n is invalid display name.
 	 */
-	NetworkUser(ID i, const std::string &n, const Status &st = Status())
-		: User(i, n, st), lastAccessed(Core::getTicks()) { }
+	NetworkUser(UserExpiryList *e, ID i, const std::string &n,
+	            const Status &st = Status())
+		: User(i, n, st), connection(0), expiry(e), list(0) {
+		accessed();
+	}
 
 	/**
 	 * Initialises User object.  User's display name is set from
 	 * <tt>i.name</tt>.
 	 *
+	 * \param e  a pair of expiry lists user will be kept on, first
+	 *           for online and second for offline users.
 	 * \param i  user's ID -- nick name, IP address pair
 	 * \param st user's status.
 	 */
-	explicit NetworkUser(ID i, const Status &st = Status())
-		: User(i, st), lastAccessed(Core::getTicks()) { }
+	NetworkUser(UserExpiryList *e, ID i, const Status &st = Status())
+		: User(i, st), connection(0), expiry(e), list(0) {
+		accessed();
+	}
 
 	/**
 	 * Initialises User object.  User's ID is set from \a n and \a
 	 * addr.
 	 *
+	 * \param e    a pair of expiry lists user will be kept on, first
+	 *             for online and second for offline users.
 	 * \param n    user's display name.
 	 * \param addr user's address (IP, port pair).
 	 * \param st   user's status.
 	 * \throw InvalidNick if \a n is invalid display name.
 	 */
-	NetworkUser(const std::string &n, Address addr, const Status &st=Status())
-		: User(n, addr, st) { }
+	NetworkUser(UserExpiryList *e, const std::string &n, Address addr,
+	            const Status &st = Status())
+		: User(n, addr, st), connection(0), expiry(e), list(0) {
+		accessed();
+	}
+
+	/** Removes user from expiry list. */
+	~NetworkUser() {
+		if (list) {
+			list->remove(*this);
+		}
+	}
 
 	/**
 	 * Returns time in ticks since last access or \c 0 if there is at
@@ -129,11 +184,26 @@ struct NetworkUser : public User {
 	}
 
 	/** Returns first connection we can send data through or \c NULL. */
-	inline NetworkConnection *getConnection();
+	NetworkConnection *getConnection() {
+		return connection;
+	}
 
-	/** Updates last access time. */
+	/**
+	 * Updates last access time and moves user to the end of
+	 * expiry list matching its state (or removes it from expiry
+	 * lists if it has connections).  Must be called after user's
+	 * state changes.
+	 */
 	void accessed() {
 		lastAccessed = Core::getTicks();
+		if (list) {
+			list->remove(*this);
+			list = 0;
+		}
+		if (connections.empty()) {
+			list = expiry + (status.state == OFFLINE);
+			list->push(*this);
+		}
 	}
 
 
@@ -141,14 +211,47 @@ private:
 	/** Active connections to user. */
 	Connections connections;
 
+	/** Connection getConnection() returns. */
+	NetworkConnection *connection;
+
+	/**
+	 * Updates \a connection after connection was attached,
+	 * deatached or started closing.
+	 */
+	inline void updateConnection();
+
 	/** Moment user did some activity last time. */
 	unsigned long lastAccessed;
 
+	/** Expiry lists for online and offline users. */
+	UserExpiryList *const expiry;
+	/** Expiry list user is on or \c NULL. */
+	UserExpiryList *list;
+	/** Previous user on expiry list. */
+	NetworkUser *prev;
+	/** Next user on expiry list. */
+	NetworkUser *next;
+
 
 	friend struct NetworkConnection;
+	friend struct UserExpiryList;
 };
 
 
+void UserExpiryList::push(NetworkUser &user) {
+	user.prev = last;
+	user.next = 0;
+	*(last ? &last->next : &first) = &user;
+	last = &user;
+}
+
+
+void UserExpiryList::remove(NetworkUser &user) {
+	*(user.prev ? &user.prev->next : &first) = user.next;
+	*(user.next ? &user.next->prev : &last ) = user.prev;
+}
+
+
 
 /** Structure holding data associated with TCP connection. */
 struct NetworkConnection {
@@ -177,17 +280,21 @@ struct NetworkConnection {
 
 
 	/**
-	 * Constructor.
+	 * Constructor.  Connection's timer is not started until rearm()
+	 * is called.
+	 * \param net     network connection belongs to.
 	 * \param sock    TCP socket.
 	 * \param ourNick our nick name.
 	 */
-	NetworkConnection(TCPSocket &sock, const std::string &ourNick)
-		: tcpSocket(sock), user(0), tokenizer(ourNick),
-		  lastAccessed(Core::getTicks()) { }
+	NetworkConnection(Network &net, TCPSocket &sock,
+	                  const std::string &ourNick)
+		: flags(0), tcpSocket(sock), user(0), tokenizer(ourNick),
+		  lastAccessed(TimerWheel::now()), network(net), timer(*this) { }
 
 	/**
 	 * Deletes a tcpSocket and deataches connection from user it is
-	 * attached to (if any).
+	 * attached to (if any).  Connection's timer is stopped when it
+	 * is destroyed.
 	 */
 	~NetworkConnection() {
 		deatach();
@@ -204,6 +311,8 @@ struct NetworkConnection {
 			deatach();
 			user = &u;
 			u.connections.push_back(this);
+			u.updateConnection();
+			u.accessed();
 		}
 	}
 
@@ -214,11 +323,24 @@ struct NetworkConnection {
 	void deatach() {
 		if (user) {
 			user->connections.erase(user->connections.find(this));
-			user->lastAccessed = Core::getTicks();
+			user->updateConnection();
+			user->accessed();
 			user = 0;
 		}
 	}
 
+	/**
+	 * Sets \c LOCAL_CLOSING flag.  Must be used instead of setting
+	 * the flag directly so that user stops sending data through
+	 * this connection.
+	 */
+	void markClosing() {
+		flags |= LOCAL_CLOSING;
+		if (user) {
+			user->updateConnection();
+		}
+	}
+
 	/** Returns \c true iff connection is attached to some user. */
 	bool isAttached() const {
 		return user;
@@ -234,17 +356,39 @@ struct NetworkConnection {
 		return user;
 	}
 
-	/** Returns time in ticks since last access. */
+	/** Returns time in milliseconds since last access. */
 	unsigned long age() const {
-		return Core::getTicks() - lastAccessed;
+		return TimerWheel::now() - lastAccessed;
 	}
 
 	/**
-	 * Returns next token from tokenizer.
+	 * Returns connection's timeout in milliseconds in current state,
+	 * ie. maximal age() after which connectionTimedOut() does
+	 * something with it.
+	 */
+	unsigned long timeout() {
+		return 1000UL * (flags & LOCAL_CLOSED ? CONNECTION_CLOSED_TIMEOUT
+		                 : tcpSocket.hasDataToWrite()
+		                 ? CONNECTION_SEND_TIMEOUT : CONNECTION_TIMEOUT);
+	}
+
+	/**
+	 * (Re)starts connection's timer so it expires when timeout()
+	 * does.  Must be called whenever connection's activity or state
+	 * changes.
+	 */
+	void rearm() {
+		const unsigned long a = age(), t = timeout();
+		network.startConnectionTimer(timer, a < t ? t - a : 0);
+	}
+
+	/**
+	 * Stores next token from tokenizer in \a token.
+	 * \param token object to store token in.
 	 * \throw xml::Error if data read from socket was invalid XML.
 	 */
-	ppcp::Tokenizer::Token nextToken() {
-		return tokenizer.nextToken();
+	void nextToken(ppcp::Tokenizer::Token &token) {
+		tokenizer.nextToken(token);
 	}
 
 	/**
@@ -253,12 +397,21 @@ struct NetworkConnection {
 	 * \throw IOException if error while reading data from socket occured.
 	 */
 	bool feed() {
-		std::string data = tcpSocket.read();
-		if (data.empty()) {
+		char *const buf = tokenizer.reserve(PPC_NETWORK_READ_SIZE);
+		std::string::size_type len;
+		try {
+			len = tcpSocket.read(buf, PPC_NETWORK_READ_SIZE);
+		}
+		catch (...) {
+			tokenizer.commit(0);
+			throw;
+		}
+		tokenizer.commit(len);
+		if (!len) {
 			return false;
 		}
-		lastAccessed = Core::getTicks();
-		tokenizer.feed(data);
+		lastAccessed = TimerWheel::now();
+		rearm();
 		return true;
 	}
 
@@ -270,7 +423,8 @@ struct NetworkConnection {
 	std::string read() {
 		std::string data = tcpSocket.read();
 		if (!data.empty()) {
-			lastAccessed = Core::getTicks();
+			lastAccessed = TimerWheel::now();
+			rearm();
 		}
 		return data;
 	}
@@ -282,7 +436,8 @@ struct NetworkConnection {
 	void write() {
 		assert(tcpSocket.hasDataToWrite());
 		tcpSocket.write();
-		lastAccessed = Core::getTicks();
+		lastAccessed = TimerWheel::now();
+		rearm();
 	}
 
 	/**
@@ -290,7 +445,31 @@ struct NetworkConnection {
 	 * \param str string to append to buffer.
 	 */
 	void push(const std::string &str) {
+		startSending();
 		tcpSocket.push(str);
+		rearm();
+	}
+
+	/**
+	 * Pushes shared buffer to send it later on.
+	 * \param buffer buffer to send.
+	 */
+	void push(const shared_obj<const Buffer> &buffer) {
+		startSending();
+		tcpSocket.push(buffer);
+		rearm();
+	}
+
+	/**
+	 * Returns string data to send may be appended to directly.
+	 * \param len number of bytes caller is going to append.
+	 * \see TCPSocket::pushInPlace()
+	 */
+	std::string &pushInPlace(std::string::size_type len) {
+		startSending();
+		std::string &out = tcpSocket.pushInPlace(len);
+		rearm();
+		return out;
 	}
 
 	/** Returns whether socket has pending data to write. */
@@ -298,11 +477,25 @@ struct NetworkConnection {
 		return tcpSocket.hasDataToWrite();
 	}
 
+	/**
+	 * Returns connection given timer belongs to.
+	 * \param timer a timer Network got in handleTimer() which is not
+	 *              any of its own timers.
+	 */
+	static NetworkConnection &fromTimer(Timer &timer) {
+		return static_cast<ConnectionTimer &>(timer).connection;
+	}
+
 	/** Returns socket's file descriptor number. */
 	int getFD() {
 		return tcpSocket.fd;
 	}
 
+	/** Returns connection's socket. */
+	TCPSocket &getSocket() {
+		return tcpSocket;
+	}
+
 	/** Returns address socket is connected to. */
 	Address getAddress() const {
 		return tcpSocket.address;
@@ -324,8 +517,41 @@ private:
 	/** Tokenizer used to parse packets. */
 	ppcp::StandAloneTokenizer tokenizer;
 
-	/** Last moment there was activity on connection. */
+	/**
+	 * Last moment (in milliseconds of TimerWheel::now()) there was
+	 * activity on connection or data started waiting to be sent.
+	 */
 	unsigned long lastAccessed;
+
+	/** Network connection belongs to. */
+	Network &network;
+
+	/** Timer which knows connection it belongs to. */
+	struct ConnectionTimer : public Timer {
+		/**
+		 * Constructor.
+		 * \param conn connection timer belongs to.
+		 */
+		explicit ConnectionTimer(NetworkConnection &conn)
+			: connection(conn) { }
+
+		/** Connection timer belongs to. */
+		NetworkConnection &connection;
+	};
+
+	/** Timer which expires when connection's timeout does. */
+	ConnectionTimer timer;
+
+
+	/**
+	 * Called before data is pushed.  If there was no data waiting
+	 * to be sent send timeout starts counting from now.
+	 */
+	void startSending() {
+		if (!tcpSocket.hasDataToWrite()) {
+			lastAccessed = TimerWheel::now();
+		}
+	}
 };
 
 
@@ -353,14 +579,19 @@ struct NetworkUsersList : sig::UsersListData {
 	NetworkUsersList(const std::string &nick, Port port)
 		: sig::UsersListData(nick, port) { }
 
+	/**
+	 * Users without connections ordered by last activity, first
+	 * with online and second with offline state.
+	 */
+	UserExpiryList expiry[2];
+
 	/**
 	 * Deletes all users in users map knowing that they are really
 	 * NetworkUser objects not User objects.
 	 */
 	virtual ~NetworkUsersList() {
 		if (!users.empty()) {
-			std::map<User::ID, User *>::iterator it = users.begin();
-			std::map<User::ID, User *>::iterator end = users.end();
+			Users::iterator it = users.begin(), end = users.end();
 			do {
 				delete static_cast<NetworkUser*>(it->second);
 			} while (++it != end);
@@ -382,13 +613,22 @@ Network::Network(Core &c, Address addr, const std::string &nick)
 	: Module(c, "/net/ppc/", seq++), address(addr),
 	  tcpListeningSocket(new TCPListeningSocket(Address())),
 	  udpSocket(new UDPSocket(addr)),
-#if PPC_NETWORK_HZ_DIVIDER > 1
-	  missedTicks(0),
-#endif
-	  lastStatus(Core::getTicks()),
+	  lastStatus(Core::getTicks()), pendingStatus(0), statusScheduled(0),
+	  statusSent(0), disconnecting(false),
 	  users(new NetworkUsersList(nick, tcpListeningSocket->address.port)),
-	  ourUser(users->ourUser) {
-	sendSignal("/net/conn/connected", "/ui/", users.get());
+	  ourUser(users->ourUser), ourPackets(ourUser) {
+	statusWindow = getConfig().getUnsigned("config/network/status-window",
+	                                       PPC_NETWORK_STATUS_WINDOW);
+	watch(*tcpListeningSocket, Poller::READ);
+	watch(*udpSocket, Poller::READ);
+	startTimer(tickTimer, PPC_NETWORK_TICK_INTERVAL,
+	           PPC_NETWORK_TICK_INTERVAL);
+	subscribe(Signal::CORE_MODULE_QUIT);
+	subscribe(Signal::NET_CONN_ARE_YOU_CONNECTED);
+	subscribe(Signal::NET_STATUS_CHANGE);
+	subscribe(Signal::NET_MSG_SEND);
+	subscribe(Signal::NET_STATUS_RQ);
+	sendSignal(Signal::NET_CONN_CONNECTED, Signal::UI_MODULES, users.get());
 }
 
 
@@ -398,7 +638,6 @@ Network::~Network() {
 	for (; it != end; ++it) {
 		delete *it;
 	}
-	connections.clear();
 	delete udpSocket;
 	delete tcpListeningSocket;
 	/* NetworkUser objects kept in \a users may reference already
@@ -409,77 +648,29 @@ Network::~Network() {
 
 
 
-int Network::setFDSets(fd_set *rd, fd_set *wr, fd_set *ex) {
-	int max = -1, fd;
-	(void)ex;
-
-	if (tcpListeningSocket) {
-		FD_SET(max = tcpListeningSocket->fd, rd);
-	}
-	if (udpSocket) {
-		FD_SET(fd = udpSocket->fd, rd);
-		if (udpSocket->hasDataToWrite()) {
-			FD_SET(fd, wr);
-		}
-		if (fd > max) {
-			max = fd;
-		}
-	}
-
-	Connections::iterator it = connections.begin(), end = connections.end();
-	for (; it != end; ++it) {
-		fd = (*it)->getFD();
-		if (!(*it)->isEOF()) {
-			FD_SET(fd, rd);
-		}
-		if ((*it)->hasDataToWrite()) {
-			FD_SET(fd, wr);
-		}
-		if (fd > max) {
-			max = fd;
-		}
-	}
-
-	return max + 1;
-}
-
-
-
-int Network::doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-                   const fd_set *ex) {
-	int handled = 0;
-	(void)ex;
-
-
-	/* Listening socekt */
-	if (tcpListeningSocket && FD_ISSET(tcpListeningSocket->fd, rd)) {
-		++handled, --nfds;
+void Network::handleFD(int fd, unsigned events) {
+	/* Listening socket */
+	if (tcpListeningSocket && fd == tcpListeningSocket->fd) {
 		try {
 			acceptConnections();
 		}
 		catch (const Exception &e) {
 			/* send signal to ourselves that we want to quit */
-			sendSignal("/core/module/quit", moduleName);
+			sendSignal(Signal::CORE_MODULE_QUIT, moduleId);
 			delete tcpListeningSocket;
 			tcpListeningSocket = 0;
-			sendSignal("/ui/msg/error", "/ui/",
+			sendSignal(Signal::UI_MSG_ERROR, Signal::UI_MODULES,
 			           "TCP listening socket error: " + e.getMessage());
 		}
-	}
 
 
 	/* Read from and write to UDP socket */
-	if (udpSocket) {
-		if (FD_ISSET(udpSocket->fd, wr)) {
-			++handled, --nfds;
-		}
-
+	} else if (udpSocket && fd == udpSocket->fd) {
 		try {
-			if (FD_ISSET(udpSocket->fd, rd)) {
-				++handled, --nfds;
+			if (events & Poller::READ) {
 				readFromUDPSocket();
 			}
-			if (FD_ISSET(udpSocket->fd, wr)) {
+			if (events & Poller::WRITE) {
 				udpSocket->write();
 				if (disconnecting && !udpSocket->hasDataToWrite()) {
 					delete udpSocket;
@@ -489,55 +680,122 @@ int Network::doFDs(int nfds, const fd_set *rd, const fd_set *wr,
 		}
 		catch (const Exception &e) {
 			/* send signal to ourselves that we want to quit */
-			sendSignal("/core/module/quit", moduleName);
+			sendSignal(Signal::CORE_MODULE_QUIT, moduleId);
 			delete udpSocket;
 			udpSocket = 0;
-			sendSignal("/ui/msg/error", "/ui/",
+			sendSignal(Signal::UI_MSG_ERROR, Signal::UI_MODULES,
 			           "UDP socket error: " + e.getMessage());
 		}
-	}
 
 
 	/* TCP sockets */
-	Connections::iterator it = connections.begin(), end = connections.end();
-	while (nfds > 0 && it != end) {
-		int fd = (*it)->getFD();
-		if (FD_ISSET(fd, wr)) {
-			++handled, --nfds;
+	} else {
+		const Connections::iterator it = findConnection(fd);
+		if (it != connections.end()) {
+			handleConnection(it, events);
 		}
+	}
 
-		try {
-			if (FD_ISSET(fd, rd)) {
-				++handled, --nfds;
-				readFromTCPConnection(**it);
-			}
-			if (FD_ISSET(fd, wr)) writeToTCPConnection (**it);
+
+	/* Are we disconnecting? */
+	if (disconnecting && !udpSocket && connections.empty()) {
+		/* If so send signal to core that we are exiting. */
+		sendSignal(Signal::CORE_MODULE_EXITS, Signal::CORE_MODULE);
+	}
+}
+
+
+
+void Network::handleConnection(Connections::iterator it, unsigned events) {
+	NetworkConnection &conn = **it;
+
+	try {
+		if (events & Poller::READ) {
+			readFromTCPConnection(conn);
 		}
-		catch (const Exception &e) {
-			sendSignal("/ui/msg/error", "/ui/",
-			           "TCP socket error: " + e.getMessage());
-			(*it)->flags |= NetworkConnection::BOTH_CLOSED;
+		if (events & Poller::WRITE) {
+			writeToTCPConnection(conn);
 		}
+	}
+	catch (const Exception &e) {
+		sendSignal(Signal::UI_MSG_ERROR, Signal::UI_MODULES,
+		           "TCP socket error: " + e.getMessage());
+		conn.flags |= NetworkConnection::BOTH_CLOSED;
+	}
 
-		/* (~a & b)  is the same thing as  (a & b) != b */
-		if (~(*it)->flags & NetworkConnection::BOTH_CLOSED) {
-			++it;
-		} else {
-			delete *it;
-			it = connections.erase(it);
-			end = connections.end();
-		}
+	/* (~a & b)  is the same thing as  (a & b) != b */
+	if (!(~conn.flags & NetworkConnection::BOTH_CLOSED)) {
+		removeConnection(it);
 	}
+}
 
 
-	/* Are we disconnecting? */
-	if (disconnecting && connections.empty()) {
-		/* If so send signal to core that we are exiting. */
-		sendSignal("/core/module/exits", Core::coreName);
+
+void Network::addConnection(NetworkConnection *conn) {
+	TCPSocket &sock = conn->getSocket();
+	try {
+		watch(sock, sock.hasDataToWrite()
+		      ? Poller::READ | Poller::WRITE : Poller::READ);
+	}
+	catch (...) {
+		delete conn;
+		throw;
+	}
+	connections.push_back(conn);
+	const int fd = conn->getFD();
+	if ((unsigned)fd >= connectionIndex.size()) {
+		connectionIndex.resize(fd + 1, -1);
+	}
+	connectionIndex[fd] = connections.size() - 1;
+	conn->rearm();
+}
+
+
+
+Network::Connections::iterator
+Network::removeConnection(Connections::iterator it) {
+	const int idx = it - connections.begin();
+	connectionIndex[(*it)->getFD()] = -1;
+	delete *it;
+	it = connections.erase(it);
+	if (it != connections.end()) {
+		connectionIndex[(*it)->getFD()] = idx;
 	}
+	return it;
+}
+
+
+
+void Network::handleTimer(Timer &timer) {
+	if (disconnecting) {
+		/* nothing */
+	} else if (&timer == &tickTimer) {
+		performTick();
+	} else if (&timer == &statusTimer) {
+		flushStatus();
+	} else {
+		connectionTimedOut(NetworkConnection::fromTimer(timer));
+	}
+}
 
 
-	return handled;
+
+void Network::connectionTimedOut(NetworkConnection &conn) {
+	if (conn.age() < conn.timeout()) {
+		conn.rearm();
+	} else if ((conn.flags & NetworkConnection::LOCAL_CLOSED) ||
+	           conn.hasDataToWrite()) {
+		removeConnection(findConnection(conn.getFD()));
+	} else {
+		/* This assert is true because if LOCAL_CLOSING flag is set
+		   then either there are pending data to be send (thus
+		   conn.hasDataToWrite() is true) or (if that's not the case)
+		   a closing tag have been already sent and thus LOCAL_CLOSED
+		   tag is set. */
+		assert((conn.flags & NetworkConnection::LOCAL_CLOSING) == 0);
+		conn.markClosing();
+		conn.push(ppcp::ppcpClose());
+	}
 }
 
 
@@ -545,17 +803,21 @@ int Network::doFDs(int nfds, const fd_set *rd, const fd_set *wr,
 void Network::recievedSignal(const Signal &sig) {
 	if (disconnecting) {
 		/* ignore all signals */
+		return;
+	}
 
-	} else if (sig.getType() == "/core/module/quit") {
+	switch (sig.getType()) {
+	case Signal::CORE_MODULE_QUIT: {
 		disconnecting = true;
 		delete tcpListeningSocket;
 		tcpListeningSocket = 0;
 
+		const shared_obj<const Buffer> close(new Buffer(ppcp::ppcpClose()));
 		Connections::iterator it(connections.begin()), end(connections.end());
 		for (; it != end; ++it) {
 			if (!((*it)->flags & NetworkConnection::LOCAL_CLOSING)) {
-				(*it)->push(ppcp::ppcpClose());
-				(*it)->flags |= NetworkConnection::LOCAL_CLOSING;
+				(*it)->push(close);
+				(*it)->markClosing();
 			}
 		}
 
@@ -565,10 +827,12 @@ void Network::recievedSignal(const Signal &sig) {
 
 		if (ourUser.status.state != User::OFFLINE) {
 			ourUser.status.state = User::OFFLINE;
-			sendSignal("/net/status/changed", "/ui/",
+			ourPackets.invalidate();
+			sendSignal(Signal::NET_STATUS_CHANGED, Signal::UI_MODULES,
 			           new sig::UserData(ourUser, sig::UserData::STATE));
-			send(ppcp::st(ourUser));
+			scheduleStatus();
 		}
+		flushStatus();
 
 		if (!udpSocket->hasDataToWrite()) {
 			delete udpSocket;
@@ -576,25 +840,20 @@ void Network::recievedSignal(const Signal &sig) {
 		}
 
 	finish_quit:
-		sendSignal("/net/conn/disconnecting", "/ui/");
+		reportStatusCounters();
+		sendSignal(Signal::NET_CONN_DISCONNECTING, Signal::UI_MODULES);
 		if (!udpSocket && connections.empty()) {
-			sendSignal("/core/module/exits", Core::coreName);
+			sendSignal(Signal::CORE_MODULE_EXITS, Signal::CORE_MODULE);
 		}
+		break;
+	}
 
-	} else if (sig.getType() == "/net/conn/are-you-connected") {
-		sendSignal("/net/conn/connected", "/ui/", users.get());
-
-	} else if (sig.getType() == "/core/tick") {
-#if PPC_NETWORK_HZ_DIVIDER > 1
-		missedTicks = (missedTicks + 1) % PPC_NETWORK_HZ_DIVIDER;
-		if (!missedTicks) {
-#endif
-			performTick();
-#if PPC_NETWORK_HZ_DIVIDER > 1
-		}
-#endif
+	case Signal::NET_CONN_ARE_YOU_CONNECTED:
+		sendSignal(Signal::NET_CONN_CONNECTED, Signal::UI_MODULES,
+		           users.get());
+		break;
 
-	} else if (sig.getType() == "/net/status/change") {
+	case Signal::NET_STATUS_CHANGE: {
 		const sig::UserData &data = *sig.getData<sig::UserData>();
 		bool request = data.flags & sig::UserData::REQUEST;
 		bool sendStatus = request;
@@ -619,30 +878,37 @@ void Network::recievedSignal(const Signal &sig) {
 		}
 
 		if (sendStatus) {
-			sendSignal("/net/status/changed", "/ui/",
+			ourPackets.invalidate();
+			sendSignal(Signal::NET_STATUS_CHANGED, Signal::UI_MODULES,
 			           new sig::UserData(ourUser, data.flags));
-			send(request ? ppcp::st(ourUser)+ppcp::rq() : ppcp::st(ourUser));
-			lastStatus = Core::getTicks();
+			scheduleStatus(request);
 		}
+		break;
+	}
 
-	} else if (sig.getType() == "/net/msg/send") {
+	case Signal::NET_MSG_SEND: {
 		const sig::MessageData &data = *sig.getData<sig::MessageData>();
 		if (data.flags & sig::MessageData::VALIDATE &&
 		    users->users.find(data.id) == users->users.end()) {
-			sendSignal("/ui/msg/info", sig.getSender(),
+			sendSignal(Signal::UI_MSG_INFO, sig.getSender(),
 			           data.id.toString() +
 			           " not connected, message not sent.");
 			return;
 		}
 
-		send(data.id,
-		     data.flags & sig::MessageData::RAW ? data.data : ppcp::m(data),
+		send(data.id, data.flags & sig::MessageData::RAW
+		     ? ppcp::Payload(data.data) : ppcp::Payload::m(data),
 		     data.flags & sig::MessageData::ALLOW_UDP);
-		sendSignal("/net/msg/sent", "/ui/", sig);
+		sendSignal(Signal::NET_MSG_SENT, Signal::UI_MODULES, sig);
+		break;
+	}
 
-	} else if (sig.getType() == "/net/status/rq") {
+	case Signal::NET_STATUS_RQ: {
 		const sig::MessageData &data = *sig.getData<sig::MessageData>();
-		send(data.id, ppcp::rq() + ppcp::st(ourUser), true);
+		send(data.id, ppcp::Payload(ppcp::rq(), ourPackets.getSt()),
+		     true);
+		break;
+	}
 	}
 }
 
@@ -652,9 +918,9 @@ void Network::acceptConnections() {
 	TCPSocket *sock;
 	while ((sock = tcpListeningSocket->accept())) {
 		NetworkConnection *conn;
-		conn = new NetworkConnection(*sock, ourUser.id.nick);
-		sock->push(ppcp::ppcpOpen(ourUser));
-		connections.push_back(conn);
+		conn = new NetworkConnection(*this, *sock, ourUser.id.nick);
+		sock->push(ourPackets.ppcpOpen());
+		addConnection(conn);
 	}
 }
 
@@ -663,47 +929,53 @@ void Network::acceptConnections() {
 void Network::readFromUDPSocket() {
 	ppcp::StandAloneTokenizer tokenizer(ourUser.id);
 	ppcp::Tokenizer::Token token;
-	std::string data;
-	Address addr;
+	unsigned count;
 
-	while (!(data = udpSocket->read(addr)).empty()) {
-		NetworkUser *user = 0;
+	do {
+		count = udpSocket->receive();
+		for (unsigned i = 0; i < count; ++i) {
+			const UDPSocket::Datagram &datagram = udpSocket->datagram(i);
+			const Address &addr = datagram.address;
+			NetworkUser *user = 0;
 
-		if (addr.port != address.port) {
-			continue;
-		}
+			if (addr.port != address.port) {
+				continue;
+			}
 
-		tokenizer.init();
-		tokenizer.feed(data);
+			tokenizer.init();
+			tokenizer.feed(datagram.data, datagram.length);
 
-		for(;;) {
-			try {
-				token = tokenizer.nextToken();
-			}
-			catch (const xml::Error &e) {
-				break;
-			}
+			for(;;) {
+				try {
+					tokenizer.nextToken(token);
+				}
+				catch (const xml::Error &e) {
+					break;
+				}
 
-			switch (token.type) {
-			case ppcp::Tokenizer::END:
-			case ppcp::Tokenizer::IGNORE:
-			case ppcp::Tokenizer::PPCP_CLOSE:
-				goto nextDatagram;
-
-			case ppcp::Tokenizer::PPCP_OPEN:
-				user = &getUser(User::ID(token.data,
-				                         Address(addr.ip, token.flags)),
-				                token.data2);
-				break;
-
-			default:
-				assert(user != 0);
-				if (user) handleToken(*user, token);
+				switch (token.type) {
+				case ppcp::Tokenizer::END:
+				case ppcp::Tokenizer::IGNORE:
+				case ppcp::Tokenizer::PPCP_CLOSE:
+					goto nextDatagram;
+
+				case ppcp::Tokenizer::PPCP_OPEN:
+					user = &getUser(User::ID(token.data,
+					                         Address(addr.ip, token.flags)),
+					                token.data2);
+					break;
+
+				default:
+					assert(user != 0);
+					if (user) handleToken(*user, token);
+				}
 			}
+
+		nextDatagram: ;
 		}
 
-	nextDatagram: ;
-	}
+	/* If less then full batch was recieved there is no more data. */
+	} while (count == PPC_UDP_BATCH);
 }
 
 
@@ -734,8 +1006,8 @@ void Network::readFromTCPConnection(NetworkConnection &conn) {
 			if (!(conn.flags & NetworkConnection::LOCAL_CLOSING)) {
 				conn.push(ppcp::ppcpClose());
 			}
-			conn.flags |= NetworkConnection::REMOTE_CLOSED |
-				NetworkConnection::LOCAL_CLOSING;
+			conn.flags |= NetworkConnection::REMOTE_CLOSED;
+			conn.markClosing();
 			goto ignore;
 
 		case ppcp::Tokenizer::PPCP_OPEN:
@@ -751,7 +1023,7 @@ void Network::readFromTCPConnection(NetworkConnection &conn) {
 			if (conn.isAttached()) handleToken(*conn.getUser(), token);
 		}
 
-		token = conn.nextToken();
+		conn.nextToken(token);
 	}
 }
 
@@ -764,6 +1036,7 @@ void Network::handleToken(NetworkUser &user,
 		unsigned flags = 0;
 		if (user.status.state != (User::State)token.flags) {
 			user.status.state = (User::State)token.flags;
+			user.accessed();
 			flags |= sig::UserData::STATE;
 		}
 		if (user.status.message != token.data) {
@@ -776,7 +1049,7 @@ void Network::handleToken(NetworkUser &user,
 		}
 
 		if (flags) {
-			sendSignal("/net/status/changed", "/ui/",
+			sendSignal(Signal::NET_STATUS_CHANGED, Signal::UI_MODULES,
 			           new sig::UserData(user, flags));
 		}
 		break;
@@ -786,15 +1059,14 @@ void Network::handleToken(NetworkUser &user,
 		if (ourUser.status.state == User::OFFLINE) {
 			/* nothing */
 		} else if (Core::getTicks() - lastStatus + 10 >= STATUS_RESEND) {
-			send(ppcp::st(ourUser));
-			lastStatus = Core::getTicks();
+			scheduleStatus();
 		} else {
-			send(user, ppcp::st(ourUser), true);
+			scheduleStatusReply(user);
 		}
 		break;
 
 	case ppcp::Tokenizer::M:
-		sendSignal("/net/msg/got", "/ui/",
+		sendSignal(Signal::NET_MSG_GOT, Signal::UI_MODULES,
 		           new sig::MessageData(user.id, token.data, token.flags));
 		break;
 
@@ -810,6 +1082,7 @@ void Network::writeToTCPConnection(NetworkConnection &conn) {
 	if ((conn.flags & NetworkConnection::LOCAL_CLOSING) &&
 	    !conn.hasDataToWrite()) {
 		conn.flags |= NetworkConnection::LOCAL_CLOSED;
+		conn.rearm();
 	}
 }
 
@@ -818,57 +1091,25 @@ void Network::writeToTCPConnection(NetworkConnection &conn) {
 void Network::performTick() {
 	if (Core::getTicks() - lastStatus >= STATUS_RESEND) {
 		if (ourUser.status.state != User::OFFLINE) {
-			send(ppcp::st(ourUser));
+			scheduleStatus();
 		}
 		lastStatus = Core::getTicks();
 	}
 
-	/* Handle connections */
-	Connections::iterator c    = connections.begin();
-	Connections::iterator cend = connections.end();
-	while (c != cend) {
-		NetworkConnection *const conn = *c;
-
-		if (conn->flags & NetworkConnection::LOCAL_CLOSED) {
-			if (conn->age() >= CONNECTION_CLOSED_TIMEOUT) goto remove;
-		} else if (conn->hasDataToWrite()) {
-			if (conn->age() >= CONNECTION_SEND_TIMEOUT) goto remove;
-		} else if (conn->age() >= CONNECTION_TIMEOUT) {
-			/* This assert is true because if LOCAL_CLOSING flag is
-			   set then either there are pending data to be send (thus
-			   conn->hasDataToWrite() is true) or (if that's not the
-			   case) a closing tag have been already sent and thus
-			   LOCAL_CLOSED tag is set. */
-			assert((conn->flags & NetworkConnection::LOCAL_CLOSING) == 0);
-			conn->flags |= NetworkConnection::LOCAL_CLOSING;
-			conn->push(ppcp::ppcpClose());
-		}
-		++c;
-		continue;
-
-	remove:
-		delete conn;
-		c = connections.erase(c);
-		cend = connections.end();
-	}
-
-	/* Handle users */
-	sig::UsersListData::Users::iterator u = users->users.begin();
-	sig::UsersListData::Users::iterator uend = users->users.end();
-	while (u != uend) {
-		NetworkUser &user = *static_cast<NetworkUser*>(u->second);
-		if (user.age() < (user.status.state == User::OFFLINE
-		                  ? OFFLINE_USER_MAX_AGE : ONLINE_USER_MAX_AGE)) {
-			++u;
-			continue;
+	/* Handle users.  Only the heads of expiry lists may be due. */
+	UserExpiryList *const expiry =
+		static_cast<NetworkUsersList&>(*users).expiry;
+	for (unsigned i = 0; i < 2; ++i) {
+		const unsigned long maxAge = i ? OFFLINE_USER_MAX_AGE
+		                               : ONLINE_USER_MAX_AGE;
+		NetworkUser *user;
+		while ((user = expiry[i].first) && user->age() >= maxAge) {
+			sendSignal(Signal::NET_STATUS_CHANGED, Signal::UI_MODULES,
+			           new sig::UserData(*user,
+			                             sig::UserData::DISCONNECTED));
+			users->users.erase(users->users.find(user->id));
+			delete user;
 		}
-
-		sendSignal("/net/status/changed", "/ui/",
-		           new sig::UserData(user, sig::UserData::DISCONNECTED));
-		users->users.erase(u);
-		u = users->users.lower_bound(user.id);
-		uend = users->users.end();
-		delete &user;
 	}
 }
 
@@ -879,8 +1120,9 @@ NetworkUser &Network::getUser(const User::ID &id, const std::string &name) {
 	if (!ret.second) {
 		static_cast<NetworkUser*>(ret.first->second)->accessed();
 	} else {
-		ret.first->second = new NetworkUser(id, name);
-		sendSignal("/net/status/changed", "/ui/",
+		ret.first->second = new NetworkUser(
+			static_cast<NetworkUsersList&>(*users).expiry, id, name);
+		sendSignal(Signal::NET_STATUS_CHANGED, Signal::UI_MODULES,
 		           new sig::UserData(*ret.first->second,
 		                             sig::UserData::CONNECTED));
 	}
@@ -889,15 +1131,15 @@ NetworkUser &Network::getUser(const User::ID &id, const std::string &name) {
 
 
 
-void Network::send(NetworkUser &user, const std::string &str, bool udp) {
+void Network::send(NetworkUser &user, const ppcp::Payload &payload,
+                   bool udp) {
 	NetworkConnection *conn = user.getConnection();
 
 	if (conn) {
 		/* nothing */
 	} else if (udp) {
-		udpSocket->push(ppcp::ppcpOpen(ourUser, user.id.nick) + str +
-		                ppcp::ppcpClose(),
-		                Address(user.id.address.ip, address.port));
+		sendDatagram(Address(user.id.address.ip, address.port),
+		             user.id.nick, payload);
 		return;
 	} else {
 		TCPSocket *sock;
@@ -905,40 +1147,161 @@ void Network::send(NetworkUser &user, const std::string &str, bool udp) {
 			sock = new TCPSocket(user.id.address);
 		}
 		catch (const IOException &e) {
-			sendSignal("/ui/msg/error", "/ui/",
+			sendSignal(Signal::UI_MSG_ERROR, Signal::UI_MODULES,
 			           "Error connecting to user: " + e.getMessage());
 			return;
 		}
-		conn = new NetworkConnection(*sock, ourUser.id.nick);
+		conn = new NetworkConnection(*this, *sock, ourUser.id.nick);
 		conn->attachTo(user);
-		connections.push_back(conn);
-		sock->push(ppcp::ppcpOpen(ourUser, user.id.nick));
+		const std::string::size_type len =
+			ourPackets.ppcpOpenLength(user.id.nick) +
+			payload.length();
+		ourPackets.appendPpcpOpen(sock->pushInPlace(len), user.id.nick);
+		try {
+			addConnection(conn);
+		}
+		catch (const IOException &e) {
+			sendSignal(Signal::UI_MSG_ERROR, Signal::UI_MODULES,
+			           "Error connecting to user: " + e.getMessage());
+			return;
+		}
 	}
 
-	conn->push(str);
+	payload.appendTo(conn->pushInPlace(payload.length()));
 }
 
 
-void Network::send(const User::ID &id, const std::string &str, bool udp) {
+void Network::send(const User::ID &id, const ppcp::Payload &payload,
+                   bool udp) {
 	if (id.address.ip && id.address.port) {
-		send(getUser(id), str, udp);
+		send(getUser(id), payload, udp);
 	} else if (!udp) {
 		/* nothing */
 	} else {
-		udpSocket->push(ppcp::ppcpOpen(ourUser, id.nick) + str +
-		                ppcp::ppcpClose(),
-		                id.address.ip
-		                ? Address(id.address.ip, address.port) : address);
+		sendDatagram(id.address.ip
+		             ? Address(id.address.ip, address.port) : address,
+		             id.nick, payload);
+	}
+}
+
+
+void Network::sendDatagram(const Address &addr, const std::string &to,
+                           const ppcp::Payload &payload) {
+	const std::string &close = ppcp::ppcpClose();
+	const std::string::size_type len =
+		ourPackets.ppcpOpenLength(to) + payload.length() +
+		close.length();
+	std::string &out = udpSocket->pushInPlace(addr, len);
+	payload.appendTo(ourPackets.appendPpcpOpen(out, to)) += close;
+}
+
+
+void Network::scheduleStatus(bool request) {
+	pendingStatus |= request ? STATUS_BROADCAST | STATUS_REQUEST
+		: STATUS_BROADCAST;
+	++statusScheduled;
+	if (!statusWindow) {
+		flushStatus();
+	} else if (!statusTimer.isRunning()) {
+		startTimer(statusTimer, statusWindow);
 	}
 }
 
 
-NetworkConnection *NetworkUser::getConnection() {
+void Network::scheduleStatusReply(const NetworkUser &user) {
+	pendingReplies.insert(std::make_pair(user.id, (User*)0));
+	++statusScheduled;
+	if (!statusWindow) {
+		flushStatus();
+	} else if (!statusTimer.isRunning()) {
+		startTimer(statusTimer, statusWindow);
+	}
+}
+
+
+void Network::flushStatus() {
+	statusTimer.stop();
+
+	/* UDP socket may have been deleted after an error while
+	   CORE_MODULE_QUIT is still waiting to be delivered. */
+	if (!udpSocket) {
+		pendingStatus = 0;
+		pendingReplies.clear();
+		return;
+	}
+
+	/* A broadcast reaches everyone so replies can be dropped. */
+	if (pendingStatus & STATUS_REQUEST) {
+		send(ppcp::Payload(ourPackets.getSt(), ppcp::rq()));
+		++statusSent;
+		lastStatus = Core::getTicks();
+	} else if (pendingStatus) {
+		announceStatus();
+		++statusSent;
+		lastStatus = Core::getTicks();
+	} else if (ourUser.status.state != User::OFFLINE) {
+		UserTable::iterator it = pendingReplies.begin();
+		const UserTable::iterator end = pendingReplies.end();
+		for (; it != end; ++it) {
+			sig::UsersListData::Users::iterator u =
+				users->users.find(it->first);
+			if (u != users->users.end()) {
+				send(*static_cast<NetworkUser*>(u->second),
+				     ourPackets.getSt(), true);
+				++statusSent;
+			}
+		}
+	}
+
+	pendingStatus = 0;
+	pendingReplies.clear();
+}
+
+
+void Network::reportStatusCounters() {
+	sprintf(sharedBuffer, "Status coalescing: %lu scheduled, %lu sent, "
+	        "%lu saved", statusScheduled, statusSent,
+	        statusScheduled - statusSent);
+	sendSignal(Signal::UI_MSG_DEBUG, Signal::UI_MODULES,
+	           std::string(sharedBuffer));
+}
+
+
+void OurPackets::build() {
+	const std::string openTag = ppcp::ppcpOpen(user);
+	prefix.assign(openTag, 0, openTag.length() - 1);
+	open = new Buffer(openTag);
+	st = new Buffer(ppcp::st(user));
+	status = new Buffer(openTag + st->data + ppcp::ppcpClose());
+	valid = true;
+}
+
+
+std::string::size_type OurPackets::ppcpOpenLength(const std::string &to) {
+	if (!valid) build();
+	return prefix.length() + 1 +
+		(to.empty() ? 0 : 8 + xml::escapedLength(to));
+}
+
+
+std::string &OurPackets::appendPpcpOpen(std::string &out,
+                                        const std::string &to) {
+	if (!valid) build();
+	out.append(prefix);
+	if (!to.empty()) {
+		xml::appendEscaped(out += " to:n=\"", to) += '"';
+	}
+	return out += '>';
+}
+
+
+
+void NetworkUser::updateConnection() {
 	Connections::iterator it = connections.begin(), end = connections.end();
 	while (it != end && (*it)->flags & NetworkConnection::LOCAL_CLOSING) {
 		++it;
 	}
-	return it == end ? 0 : *it;
+	connection = it == end ? 0 : *it;
 }
 
 }
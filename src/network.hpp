@@ -19,21 +19,38 @@
 #ifndef H_NETWORK_HPP
 #define H_NETWORK_HPP
 
+#include <vector>
+
 #include "application.hpp"
 #include "netio.hpp"
 #include "user.hpp"
+#include "user-table.hpp"
 #include "unordered-vector.hpp"
 #include "ppcp-parser.hpp"
 #include "ppcp-packets.hpp"
 
 
 /**
- * Intervfal between checking timeouts.  This may have value greater
- * then one to save some CPU time as Network will investigate all
- * users and all connections once every HZ_DIVIDER seconds instead of
- * every second.
+ * Interval between checking timeouts in milliseconds.  This may have
+ * value greater then a second to save some CPU time as Network will
+ * check users' timeouts and resend status only once every interval.
+ */
+#define PPC_NETWORK_TICK_INTERVAL    10000
+
+/**
+ * Default length of status coalescing window in milliseconds; may be
+ * changed with \c config/network/status-window option.  Status
+ * announcements and replies to \c rq requests scheduled within the
+ * window are merged and sent when it ends.  Zero disables
+ * coalescing.
  */
-#define PPC_NETWORK_HZ_DIVIDER       10
+#define PPC_NETWORK_STATUS_WINDOW      250
+
+/**
+ * Maximal number of bytes read from TCP connection at once.  Data is
+ * read directly into connection's tokenizer buffer.
+ */
+#define PPC_NETWORK_READ_SIZE         4096
 
 
 namespace ppc {
@@ -43,6 +60,80 @@ struct NetworkConnection;
 struct NetworkUser;
 
 
+/**
+ * Pre-serialised packets announcing our user which are sent over and
+ * over again: \c ppcp opening tag, \c st element and a complete
+ * status packet.  They are built on first use and kept till
+ * invalidate() is called which must happen each time our user
+ * changes.
+ */
+struct OurPackets {
+	/**
+	 * Constructor.
+	 * \param u our user.
+	 */
+	explicit OurPackets(const User &u) : user(u), valid(false) { }
+
+	/** Drops cached packets; called when our user changes. */
+	void invalidate() {
+		valid = false;
+		open = status = st = (Buffer*)0;
+	}
+
+	/** Returns \c ppcp opening tag. */
+	const shared_obj<const Buffer> &ppcpOpen() {
+		if (!valid) build();
+		return open;
+	}
+
+	/**
+	 * Returns length of \c ppcp opening tag with \c to:n attribute.
+	 * \param to value of \c to:n attribute; if empty attribute is
+	 *           omitted.
+	 */
+	std::string::size_type ppcpOpenLength(const std::string &to);
+
+	/**
+	 * Appends \c ppcp opening tag with \c to:n attribute to \a out.
+	 * \param out string to append tag to.
+	 * \param to  value of \c to:n attribute; if empty attribute is
+	 *            omitted.
+	 * \return reference to \a out.
+	 */
+	std::string &appendPpcpOpen(std::string &out, const std::string &to);
+
+	/** Returns \c st element describing our user. */
+	const std::string &getSt() {
+		if (!valid) build();
+		return st->data;
+	}
+
+	/** Returns complete packet with our user's \c st element. */
+	const shared_obj<const Buffer> &statusPacket() {
+		if (!valid) build();
+		return status;
+	}
+
+
+private:
+	/** Our user. */
+	const User &user;
+	/** Whether cached packets are up to date. */
+	bool valid;
+	/** \c ppcp opening tag without closing \c '>'. */
+	std::string prefix;
+	/** \c ppcp opening tag. */
+	shared_obj<const Buffer> open;
+	/** \c st element. */
+	shared_obj<const Buffer> st;
+	/** \c ppcp opening tag, \c st element and \c ppcp closing tag. */
+	shared_obj<const Buffer> status;
+
+	/** Builds all packets. */
+	void build();
+};
+
+
 /**
  * Module maintaining network communication.
  */
@@ -64,9 +155,8 @@ struct Network : public Module {
 	/** Frees all resources and closes connections. */
 	~Network();
 
-	virtual int setFDSets(fd_set *rd, fd_set *wr, fd_set *ex);
-	virtual int doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-	                  const fd_set *ex);
+	virtual void handleFD(int fd, unsigned events);
+	virtual void handleTimer(Timer &timer);
 	virtual void recievedSignal(const Signal &sig);
 
 
@@ -116,39 +206,145 @@ private:
 
 
 	/**
-	 * Removes all users and closes all connections that age exceeded
-	 * max age.
+	 * Handles events on given TCP connection.  If connection gets
+	 * closed it is removed from \a connections list and deleted.
+	 * \param it     iterator pointing to connection.
+	 * \param events combination of Poller::READ and Poller::WRITE
+	 *               flags.
+	 */
+	void handleConnection(Connections::iterator it, unsigned events);
+
+	/**
+	 * Adds connection to \a connections list and starts watching its
+	 * socket.  If watching fails connection is deleted.
+	 * \param conn connection to add.
+	 * \throw IOException if error occured.
+	 */
+	void addConnection(NetworkConnection *conn);
+
+	/**
+	 * Removes connection from \a connections list and deletes it
+	 * (which also stops watching its socket).
+	 * \param it iterator pointing to connection.
+	 * \return iterator pointing to the next connection.
+	 */
+	Connections::iterator removeConnection(Connections::iterator it);
+
+	/**
+	 * Returns iterator pointing to connection with given socket.
+	 * \param fd socket's file descriptor.
+	 * \return iterator pointing to connection or end of \a
+	 *         connections list if there is no such connection.
+	 */
+	Connections::iterator findConnection(int fd) {
+		return fd >= 0 && (unsigned)fd < connectionIndex.size() &&
+			connectionIndex[fd] >= 0
+			? connections.begin() + connectionIndex[fd]
+			: connections.end();
+	}
+
+
+	/**
+	 * Removes all users that age exceeded max age.  Users are kept
+	 * on expiry lists ordered by last activity so only those which
+	 * are due are looked at.
 	 */
 	void performTick();
 
+	/**
+	 * Handles expired timeout of given connection: either closes
+	 * \c ppcp element or removes connection.
+	 * \param conn connection which timer expired.
+	 */
+	void connectionTimedOut(NetworkConnection &conn);
+
+	/**
+	 * Starts connection's timer.  Used by NetworkConnection which
+	 * cannot start timers by itself.
+	 * \param timer connection's timer.
+	 * \param delay number of milliseconds after which timer expires.
+	 */
+	void startConnectionTimer(Timer &timer, unsigned long delay) {
+		startTimer(timer, delay);
+	}
+
+
+	/**
+	 * Sends given payload to given user or to whole network.
+	 * \param user    user to send packet to.
+	 * \param payload payload to send.
+	 * \param udp     whether data may be send through UDP multicast.
+	 */
+	void send(NetworkUser &user, const ppcp::Payload &payload,
+	          bool udp = false);
+
 
 	/**
-	 * Sends given string to given user or to whole network.
-	 * \param user user to send packet to.
-	 * \param str  string to send.
-	 * \param udp  whether data may be send through UDP multicast.
+	 * Sends given payload to given user or to whole network.
+	 * \param id      user's ID to send packet to..
+	 * \param payload payload to send.
+	 * \param udp     whether data may be send through UDP multicast.
 	 */
-	void send(NetworkUser &user, const std::string &str, bool udp = false);
+	void send(const User::ID &id, const ppcp::Payload &payload,
+	          bool udp = false);
 
 
 	/**
-	 * Sends given string to given user or to whole network.
-	 * \param id   user's ID to send packet to..
-	 * \param str  string to send.
-	 * \param udp  whether data may be send through UDP multicast.
+	 * Sends given payload to all users (using multicast UDP).
+	 * \param payload payload to send.
 	 */
-	void send(const User::ID &id, const std::string &str, bool udp = false);
+	void send(const ppcp::Payload &payload) {
+		const std::string &open = ourPackets.ppcpOpen()->data;
+		const std::string &close = ppcp::ppcpClose();
+		std::string &out = udpSocket->pushInPlace(address,
+			open.length() + payload.length() + close.length());
+		payload.appendTo(out += open) += close;
+	}
 
 
 	/**
-	 * Sends given string to all users (using multicast UDP).
-	 * \param str  string to send.
+	 * Sends a single datagram with given payload.  Whole datagram is
+	 * built directly in socket's queue.
+	 * \param addr    address to send datagram to.
+	 * \param to      value of \c to:n attribute.
+	 * \param payload payload to send.
 	 */
-	void send(const std::string &str) {
-		udpSocket->push(ppcp::ppcpOpen(ourUser) + str + ppcp::ppcpClose(),
-		                address);
+	void sendDatagram(const Address &addr, const std::string &to,
+	                  const ppcp::Payload &payload);
+
+	/** Sends our user's status to all users (using multicast UDP). */
+	void announceStatus() {
+		udpSocket->push(ourPackets.statusPacket(), address);
 	}
 
+	/**
+	 * Schedules broadcast of our user's status.  It will be sent
+	 * when status coalescing window ends together with all other
+	 * broadcasts scheduled within the window.
+	 * \param request whether to add \c rq element asking all users
+	 *                to send their status.
+	 */
+	void scheduleStatus(bool request = false);
+
+	/**
+	 * Schedules a reply with our user's status to given user.
+	 * Repeated replies to the same user within status coalescing
+	 * window are merged and all replies are dropped if a broadcast
+	 * is sent in the same window.
+	 * \param user user to reply to.
+	 */
+	void scheduleStatusReply(const NetworkUser &user);
+
+	/** Sends scheduled status broadcast or replies immediately. */
+	void flushStatus();
+
+	/**
+	 * Sends a \c /ui/msg/debug signal telling how many status
+	 * broadcasts and replies were scheduled and how many of them
+	 * status coalescing saved.
+	 */
+	void reportStatusCounters();
+
 
 	/**
 	 * Returns user with given ID.  If such user does not exist
@@ -174,12 +370,43 @@ private:
 	/** Vector of TCP sockets. */
 	Connections connections;
 
-	/** Number of ticks Network did not check if users/connections got old. */
-	unsigned missedTicks;
+	/**
+	 * Positions in \a connections list indexed by connections'
+	 * file descriptors or \c -1 for descriptors which are not TCP
+	 * connections.
+	 */
+	std::vector<int> connectionIndex;
+
+	/** Timer which triggers checking if users got old. */
+	Timer tickTimer;
 
 	/** Last time status was sent. */
 	unsigned lastStatus;
 
+	/** Pending status broadcast flags. */
+	enum {
+		STATUS_BROADCAST = 1,  /**< Status broadcast is scheduled. */
+		STATUS_REQUEST   = 2   /**< Broadcast shall include \c rq. */
+	};
+
+	/** Timer which ends status coalescing window. */
+	Timer statusTimer;
+
+	/** Length of status coalescing window in milliseconds. */
+	unsigned long statusWindow;
+
+	/** Combination of STATUS_BROADCAST and STATUS_REQUEST flags. */
+	unsigned pendingStatus;
+
+	/** Users scheduled to get a status reply. */
+	UserTable pendingReplies;
+
+	/** Number of status broadcasts and replies scheduled. */
+	unsigned long statusScheduled;
+
+	/** Number of status broadcasts and replies really sent. */
+	unsigned long statusSent;
+
 	/** If \c true we are disconnecting; many signals are ignored. */
 	bool disconnecting;
 
@@ -188,6 +415,12 @@ private:
 
 	/** Reference to ourUser field from users. */
 	User &ourUser;
+
+	/** Cached packets announcing ourUser. */
+	OurPackets ourPackets;
+
+
+	friend struct NetworkConnection;
 };
 
 
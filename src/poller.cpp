@@ -0,0 +1,320 @@
+/** \file
+ * File descriptors readiness notification implementation.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#ifdef __linux__
+#  include <sys/epoll.h>
+#endif
+
+#include "poller.hpp"
+
+
+/** Maximal number of events reported by single epoll_pwait() call. */
+#define PPC_POLLER_MAX_EVENTS 64
+
+
+namespace ppc {
+
+
+void Poller::add(int fd, unsigned events, FDHandler &handler) {
+	assert(fd >= 0);
+	assert(!isWatched(fd));
+
+	if ((unsigned)fd >= entries.size()) {
+		entries.resize(fd + 1);
+	}
+	if (events) {
+		doAdd(fd, events);
+	}
+	entries[fd].handler = &handler;
+	entries[fd].events = events;
+}
+
+
+void Poller::modify(int fd, unsigned events) {
+	assert(isWatched(fd));
+
+	Entry &entry = entries[fd];
+	if (entry.events == events) {
+		return;
+	}
+
+	/* Descriptors with no events are removed from kernel's set since
+	   otherwise hang ups would be reported over and over again. */
+	if (!events) {
+		doRemove(fd);
+	} else if (!entry.events) {
+		doAdd(fd, events);
+	} else {
+		doModify(fd, events);
+	}
+	entry.events = events;
+}
+
+
+void Poller::remove(int fd) {
+	if (!isWatched(fd)) {
+		return;
+	}
+
+	Entry &entry = entries[fd];
+	if (entry.events) {
+		doRemove(fd);
+	}
+	entry.handler = 0;
+	entry.events = 0;
+}
+
+
+int Poller::poll(int timeout, const sigset_t *sigmask) {
+	int n = wait(timeout, sigmask);
+	if (n <= 0) {
+		return n;
+	}
+
+	int handled = 0;
+	for (int i = 0; i < n; ++i) {
+		const Event &event = ready[i];
+
+		/* Handler of previous descriptor might have removed this one
+		   or changed its events. */
+		const unsigned events = event.events & getEvents(event.fd);
+		if (events) {
+			entries[event.fd].handler->handleFD(event.fd, events);
+			++handled;
+		}
+	}
+	return handled;
+}
+
+
+
+#ifdef __linux__
+
+/** An epoll(7) based Poller. */
+struct EpollPoller : public Poller {
+	/**
+	 * Creates epoll instance.
+	 * \throw IOException if error occured.
+	 */
+	EpollPoller() : epfd(epoll_create(PPC_POLLER_MAX_EVENTS)) {
+		if (epfd < 0) {
+			throw IOException("epoll_create: ", errno);
+		}
+		fcntl(epfd, F_SETFD, FD_CLOEXEC);
+	}
+
+	/** Closes epoll instance. */
+	~EpollPoller() {
+		close(epfd);
+	}
+
+protected:
+	virtual void doAdd(int fd, unsigned events) {
+		control(EPOLL_CTL_ADD, fd, events);
+	}
+
+	virtual void doModify(int fd, unsigned events) {
+		control(EPOLL_CTL_MOD, fd, events);
+	}
+
+	virtual void doRemove(int fd) {
+		struct epoll_event ev;
+		epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+	}
+
+	virtual int wait(int timeout, const sigset_t *sigmask);
+
+private:
+	/** epoll instance file descriptor. */
+	const int epfd;
+
+	/** Buffer for events returned by kernel. */
+	struct epoll_event eventBuffer[PPC_POLLER_MAX_EVENTS];
+
+	/**
+	 * Calls epoll_ctl().
+	 * \param op     operation.
+	 * \param fd     file descriptor.
+	 * \param events combination of READ and WRITE flags.
+	 * \throw IOException if error occured.
+	 */
+	void control(int op, int fd, unsigned events) {
+		struct epoll_event ev;
+		ev.events = (events & READ ? (unsigned)EPOLLIN : 0u) |
+			(events & WRITE ? (unsigned)EPOLLOUT : 0u);
+		ev.data.u64 = 0;
+		ev.data.fd = fd;
+		if (epoll_ctl(epfd, op, fd, &ev) < 0) {
+			throw IOException("epoll_ctl: ", errno);
+		}
+	}
+};
+
+
+int EpollPoller::wait(int timeout, const sigset_t *sigmask) {
+	const int n = epoll_pwait(epfd, eventBuffer, PPC_POLLER_MAX_EVENTS,
+	                          timeout, sigmask);
+	if (n <= 0) {
+		return n;
+	}
+
+	ready.resize(n);
+	for (int i = 0; i < n; ++i) {
+		const unsigned ev = eventBuffer[i].events;
+		ready[i].fd = eventBuffer[i].data.fd;
+		ready[i].events = ev & (EPOLLERR | EPOLLHUP) ? READ | WRITE
+			: (ev & EPOLLIN ? READ : 0) | (ev & EPOLLOUT ? WRITE : 0);
+	}
+	return n;
+}
+
+#endif
+
+
+
+/**
+ * A pselect() based Poller.  It is used when no better mechanism is
+ * available.  It can handle only descriptors less then \c FD_SETSIZE
+ * and its cost is linear in number of watched descriptors.
+ */
+struct SelectPoller : public Poller {
+	/** Default constructor. */
+	SelectPoller() : maxfd(-1) {
+		FD_ZERO(&rdset);
+		FD_ZERO(&wrset);
+	}
+
+protected:
+	virtual void doAdd(int fd, unsigned events) {
+		if (fd >= FD_SETSIZE) {
+			throw IOException("select: descriptor exceeds FD_SETSIZE");
+		}
+		doModify(fd, events);
+		if (fd > maxfd) {
+			maxfd = fd;
+		}
+	}
+
+	virtual void doModify(int fd, unsigned events) {
+		if (events & READ ) FD_SET(fd, &rdset); else FD_CLR(fd, &rdset);
+		if (events & WRITE) FD_SET(fd, &wrset); else FD_CLR(fd, &wrset);
+	}
+
+	virtual void doRemove(int fd) {
+		FD_CLR(fd, &rdset);
+		FD_CLR(fd, &wrset);
+		while (maxfd >= 0 && !FD_ISSET(maxfd, &rdset) &&
+		       !FD_ISSET(maxfd, &wrset)) {
+			--maxfd;
+		}
+	}
+
+	virtual int wait(int timeout, const sigset_t *sigmask);
+
+private:
+	/** Greatest descriptor in any set or -1. */
+	int maxfd;
+	/** Descriptors watched for reading. */
+	fd_set rdset;
+	/** Descriptors watched for writing. */
+	fd_set wrset;
+};
+
+
+int SelectPoller::wait(int timeout, const sigset_t *sigmask) {
+	struct timespec ts, *tsp = 0;
+	fd_set rd = rdset, wr = wrset;
+
+	if (timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000L;
+		tsp = &ts;
+	}
+
+	int n = pselect(maxfd + 1, &rd, &wr, 0, tsp, sigmask);
+	if (n <= 0) {
+		return n;
+	}
+
+	ready.clear();
+	for (int fd = 0; n > 0 && fd <= maxfd; ++fd) {
+		const unsigned events = (FD_ISSET(fd, &rd) ? READ : 0) |
+			(FD_ISSET(fd, &wr) ? WRITE : 0);
+		if (events) {
+			Event event;
+			event.fd = fd;
+			event.events = events;
+			ready.push_back(event);
+			n -= (events & READ ? 1 : 0) + (events & WRITE ? 1 : 0);
+		}
+	}
+	return ready.size();
+}
+
+
+
+void FileDescriptor::watch(Poller &p, FDHandler &handler, unsigned events) {
+	assert(!poller);
+	p.add(fd, events, handler);
+	poller = &p;
+}
+
+
+void FileDescriptor::unwatch() {
+	if (poller) {
+		poller->remove(fd);
+		poller = 0;
+	}
+}
+
+
+void FileDescriptor::addEvents(unsigned events) {
+	if (poller) {
+		poller->modify(fd, poller->getEvents(fd) | events);
+	}
+}
+
+
+void FileDescriptor::removeEvents(unsigned events) {
+	if (poller) {
+		poller->modify(fd, poller->getEvents(fd) & ~events);
+	}
+}
+
+
+
+Poller *Poller::create() {
+#ifdef __linux__
+	try {
+		return new EpollPoller();
+	}
+	catch (const IOException &e) {
+		/* fall back to pselect() */
+	}
+#endif
+	return new SelectPoller();
+}
+
+
+}
@@ -0,0 +1,231 @@
+/** \file
+ * File descriptors readiness notification.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_POLLER_HPP
+#define H_POLLER_HPP
+
+#include <signal.h>
+
+#include <vector>
+
+#include "io.hpp"
+
+
+namespace ppc {
+
+
+/**
+ * An object which wants to be notified when file descriptor it
+ * registered in a Poller becomes ready.
+ */
+struct FDHandler {
+	/** Destructor. */
+	virtual ~FDHandler() { }
+
+	/**
+	 * Called by Poller when file descriptor is ready.  \a events is
+	 * a combination of Poller::READ and Poller::WRITE flags and
+	 * includes only events handler is interested in.  If an error
+	 * or hang up occured on a descriptor it is reported as all the
+	 * events handler is interested in so that subsequent read or
+	 * write operation will report the error.
+	 *
+	 * \param fd     file descriptor which is ready.
+	 * \param events events which occured.
+	 */
+	virtual void handleFD(int fd, unsigned events) = 0;
+};
+
+
+
+/**
+ * An abstract readiness notification backend.  Unlike select() the
+ * interest in each file descriptor is registered once and modified
+ * only when it changes and only descriptors which are ready are
+ * reported so cost of waiting depends on activity rather than on
+ * number of descriptors.
+ *
+ * Poller keeps a table indexed by file descriptor number holding
+ * handler and events for each watched descriptor.  Concrete
+ * implementations (see create()) need only to maintain kernel's
+ * state and report which descriptors are ready.
+ */
+struct Poller {
+	/** Events. */
+	enum {
+		READ  = 1,  /**< Descriptor is readable. */
+		WRITE = 2   /**< Descriptor is writable. */
+	};
+
+
+	/**
+	 * Creates the best backend available on the system.  On Linux
+	 * this is an epoll(7) based backend, anywhere else (or if
+	 * creating epoll instance failed) a pselect() based one.
+	 * \throw IOException if error occured.
+	 */
+	static Poller *create();
+
+
+	/** Destructor. */
+	virtual ~Poller() { }
+
+
+	/**
+	 * Starts watching file descriptor.  \a events may be zero in
+	 * which case descriptor is registered but won't be reported
+	 * until events are set with modify().
+	 *
+	 * \param fd      file descriptor to watch.
+	 * \param events  combination of READ and WRITE flags.
+	 * \param handler object to notify when descriptor is ready.
+	 * \throw IOException if error occured.
+	 */
+	void add(int fd, unsigned events, FDHandler &handler);
+
+	/**
+	 * Changes events file descriptor is watched for.  If events do
+	 * not change no system call is made so it is cheap to call this
+	 * method each time interest might have changed.
+	 *
+	 * \param fd     file descriptor.
+	 * \param events combination of READ and WRITE flags.
+	 * \throw IOException if error occured.
+	 */
+	void modify(int fd, unsigned events);
+
+	/**
+	 * Stops watching file descriptor.  This must be called before
+	 * descriptor is closed.  Pending events for the descriptor won't
+	 * be reported.
+	 *
+	 * \param fd file descriptor.
+	 */
+	void remove(int fd);
+
+	/**
+	 * Returns events given file descriptor is watched for or zero if
+	 * it is not watched.
+	 * \param fd file descriptor.
+	 */
+	unsigned getEvents(int fd) const {
+		return (unsigned)fd < entries.size() ? entries[fd].events : 0;
+	}
+
+	/**
+	 * Returns \c true iff file descriptor is watched.
+	 * \param fd file descriptor.
+	 */
+	bool isWatched(int fd) const {
+		return (unsigned)fd < entries.size() && entries[fd].handler;
+	}
+
+
+	/**
+	 * Waits for file descriptors to become ready and calls their
+	 * handlers.
+	 *
+	 * \param timeout maximal time to wait in milliseconds or -1 to
+	 *                wait infinitely.
+	 * \param sigmask signal mask to set atomically for the time of
+	 *                waiting or \c NULL.
+	 * \return number of events dispatched, zero on timeout or -1 on
+	 *         error in which case \c errno is set (\c EINTR if
+	 *         a signal was caught).
+	 */
+	int poll(int timeout, const sigset_t *sigmask = 0);
+
+
+protected:
+	/** Ready file descriptor and its events. */
+	struct Event {
+		/** File descriptor. */
+		int fd;
+		/** Events combination of READ and WRITE flags. */
+		unsigned events;
+	};
+
+	/** List of ready descriptors filled by wait(). */
+	std::vector<Event> ready;
+
+
+	/** Default constructor. */
+	Poller() { }
+
+
+	/**
+	 * Registers descriptor in kernel.
+	 * \param fd     file descriptor.
+	 * \param events combination of READ and WRITE flags, never zero.
+	 * \throw IOException if error occured.
+	 */
+	virtual void doAdd(int fd, unsigned events) = 0;
+
+	/**
+	 * Changes registered events in kernel.
+	 * \param fd     file descriptor.
+	 * \param events combination of READ and WRITE flags, never zero.
+	 * \throw IOException if error occured.
+	 */
+	virtual void doModify(int fd, unsigned events) = 0;
+
+	/**
+	 * Unregisters descriptor from kernel.
+	 * \param fd file descriptor.
+	 */
+	virtual void doRemove(int fd) = 0;
+
+	/**
+	 * Waits for events and fills \a ready list.  Events may include
+	 * flags descriptor is not watched for (they will be masked).
+	 *
+	 * \param timeout maximal time to wait in milliseconds or -1.
+	 * \param sigmask signal mask to set while waiting or \c NULL.
+	 * \return number of elements in \a ready, zero on timeout or -1
+	 *         on error.
+	 */
+	virtual int wait(int timeout, const sigset_t *sigmask) = 0;
+
+
+private:
+	/** Watched file descriptor. */
+	struct Entry {
+		/** Default constructor. */
+		Entry() : handler(0), events(0) { }
+		/** Handler or \c NULL if descriptor is not watched. */
+		FDHandler *handler;
+		/** Events descriptor is watched for. */
+		unsigned events;
+	};
+
+	/** Watched file descriptors indexed by descriptor number. */
+	std::vector<Entry> entries;
+
+
+	/** Copying not allowed.
+	 * \param p ignored. */
+	Poller(const Poller &p) { (void)p; }
+	/** Copying not allowed.
+	 * \param p ignored. */
+	void operator=(const Poller &p) { (void)p; }
+};
+
+
+}
+
+#endif
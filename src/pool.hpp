@@ -0,0 +1,150 @@
+/** \file
+ * Per-type free-list memory pool.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_POOL_HPP
+#define H_POOL_HPP
+
+#include <stddef.h>
+
+#include <new>
+
+
+/**
+ * Maximal number of free blocks each pool keeps.  Blocks freed when
+ * pool is full are returned to the system.
+ */
+#define PPC_POOL_MAX_FREE      256
+
+
+/**
+ * Defines class specific operator new and operator delete which use
+ * Pool<type>.  This is meant to be used inside of definition of
+ * classes which are frequently allocated and freed.
+ *
+ * Since derived classes inherit those operators each class in
+ * hierarchy should use this macro; otherwise objects of derived class
+ * will be allocated with global operator new (as Pool notices size
+ * mismatch) bypassing the pool.
+ *
+ * \param type class being defined.
+ */
+#define PPC_POOL_OPERATORS(type) \
+	static void *operator new(size_t size) { \
+		return ppc::Pool<type>::allocate(size); \
+	} \
+	static void operator delete(void *ptr, size_t size) { \
+		ppc::Pool<type>::release(ptr, size); \
+	}
+
+
+namespace ppc {
+
+
+/**
+ * A free-list pool of memory blocks of size of \a T.  Freed blocks
+ * are kept on a list and reused by following allocations so objects
+ * which are created and destroyed often do not hit malloc() each
+ * time.  Pool counts allocations served from free list (hits) and
+ * those which needed to call global operator new (misses).
+ *
+ * Pool is not thread safe.
+ */
+template<class T>
+struct Pool {
+	/**
+	 * Allocates memory block.
+	 * \param size requested size; if it's not \c sizeof(T) block is
+	 *             allocated with global operator new.
+	 * \return allocated memory.
+	 * \throw std::bad_alloc if allocation failed.
+	 */
+	static void *allocate(size_t size) {
+		if (size != sizeof(T)) {
+			return ::operator new(size);
+		} else if (freeList) {
+			Block *const block = freeList;
+			freeList = block->next;
+			--freeCount;
+			++hitCount;
+			return block;
+		} else {
+			++missCount;
+			return ::operator new(sizeof(Block));
+		}
+	}
+
+	/**
+	 * Frees memory block allocated with allocate().
+	 * \param ptr  memory block.
+	 * \param size block size as passed to allocate().
+	 */
+	static void release(void *ptr, size_t size) {
+		if (!ptr) {
+			/* nothing */
+		} else if (size == sizeof(T) && freeCount < PPC_POOL_MAX_FREE) {
+			Block *const block = static_cast<Block*>(ptr);
+			block->next = freeList;
+			freeList = block;
+			++freeCount;
+		} else {
+			::operator delete(ptr);
+		}
+	}
+
+	/** Returns number of allocations served from free list. */
+	static unsigned long hits() { return hitCount; }
+
+	/** Returns number of allocations which called operator new. */
+	static unsigned long misses() { return missCount; }
+
+	/** Returns number of blocks on free list. */
+	static unsigned long available() { return freeCount; }
+
+
+private:
+	/** A free memory block. */
+	union Block {
+		/** Next free block. */
+		Block *next;
+		/** Storage for an object. */
+		char data[sizeof(T)];
+	};
+
+	/** List of free blocks. */
+	static Block *freeList;
+
+	/** Number of blocks on free list. */
+	static unsigned long freeCount;
+
+	/** Number of allocations served from free list. */
+	static unsigned long hitCount;
+
+	/** Number of allocations which called operator new. */
+	static unsigned long missCount;
+};
+
+
+template<class T> typename Pool<T>::Block *Pool<T>::freeList = 0;
+template<class T> unsigned long Pool<T>::freeCount = 0;
+template<class T> unsigned long Pool<T>::hitCount = 0;
+template<class T> unsigned long Pool<T>::missCount = 0;
+
+
+}
+
+#endif
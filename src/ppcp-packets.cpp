@@ -19,6 +19,7 @@
 #include <assert.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include "ppcp-packets.hpp"
 
@@ -26,60 +27,111 @@ namespace ppc {
 namespace ppcp {
 
 
-std::string ppcpOpen(const User &user) {
-	sprintf(sharedBuffer, "\" p=\"%u\">", user.id.address.port.host());
-	return "<ppcp n=\"" +
-		xml::escape(User::nameMatchesNick(user.name, user.id.nick)
-		            ? user.name : user.id.nick) + sharedBuffer;
+/**
+ * Returns name \c n attribute of \c ppcp open tag is set to.
+ * \param user user object.
+ */
+static inline const std::string &ppcpName(const User &user) {
+	return User::nameMatchesNick(user.name, user.id.nick)
+		? user.name : user.id.nick;
+}
+
+
+/**
+ * Formats part of \c ppcp open tag which goes between user's name and
+ * value of \c to:n attribute.
+ * \param buf  buffer to format into.
+ * \param user user object.
+ * \param to   value of \c to:n attribute (or empty string).
+ * \param neg  if \c true \c to:neg will be set to \c "neg".
+ * \return length of formatted data.
+ */
+static int ppcpMiddle(char *buf, const User &user, const std::string &to,
+                      bool neg) {
+	return sprintf(buf,
+	               !to.empty() ? neg ? "\" p=\"%u\" to:neg=\"neg\" to:n=\""
+	                                 : "\" p=\"%u\" to:n=\""
+	                           : "\" p=\"%u\">",
+	               user.id.address.port.host());
 }
 
 
-std::string ppcpOpen(const User &user, const std::string &to, bool neg) {
-	sprintf(sharedBuffer,
-	        !to.empty() ? neg ? "\" p=\"%u\" to:neg=\"neg\" to:n=\""
-	                          : "\" p=\"%u\" to:n=\""
-	                   : "\" p=\"%u\">",
-	        user.id.address.port.host());
+std::string::size_type ppcpOpenLength(const User &user,
+                                      const std::string &to, bool neg) {
+	char buf[64];
+	return 9 + xml::escapedLength(ppcpName(user)) +
+		ppcpMiddle(buf, user, to, neg) +
+		(to.empty() ? 0 : xml::escapedLength(to) + 2);
+}
+
 
-	std::string packet = "<ppcp n=\"" +
-		xml::escape(User::nameMatchesNick(user.name, user.id.nick)
-		            ? user.name : user.id.nick) + sharedBuffer;
+std::string &appendPpcpOpen(std::string &out, const User &user,
+                            const std::string &to, bool neg) {
+	char buf[64];
+	const int len = ppcpMiddle(buf, user, to, neg);
+	out += "<ppcp n=\"";
+	xml::appendEscaped(out, ppcpName(user)).append(buf, len);
 	if (!to.empty()) {
-		packet += xml::escape(to) + "\">";
+		xml::appendEscaped(out, to) += "\">";
 	}
-	return packet;
+	return out;
 }
 
 
-std::string st(User::State st, const std::string &msg,
-               const std::string &name) {
-	std::string packet;
+/**
+ * Returns beginning of \c st element for given state.
+ * \param st user's state.
+ */
+static const char *stStart(User::State st) {
 	switch (st) {
-	case User::OFFLINE: packet = "<st st=\"off\"" ; break;
-	case User::AWAY   : packet = "<st st=\"away\""; break;
-	case User::XAWAY  : packet = "<st st=\"xa\""  ; break;
-	case User::BUSY   : packet = "<st st=\"dnd\"" ; break;
+	case User::OFFLINE: return "<st st=\"off\"" ;
+	case User::AWAY   : return "<st st=\"away\"";
+	case User::XAWAY  : return "<st st=\"xa\""  ;
+	case User::BUSY   : return "<st st=\"dnd\"" ;
 	default           : assert(st == User::ONLINE);
-	                    packet = "<st"            ; break;
+	                    return "<st"            ;
 	}
+}
+
+
+std::string::size_type stLength(User::State st, const std::string &msg,
+                                const std::string &name) {
+	return strlen(stStart(st)) +
+		(name.empty() ? 0 : 6 + xml::escapedLength(name)) +
+		(msg.empty() ? 2 : 6 + xml::escapedLength(msg));
+}
 
+
+std::string &appendSt(std::string &out, User::State st,
+                      const std::string &msg, const std::string &name) {
+	out += stStart(st);
 	if (!name.empty()) {
-		packet += " dn=\"" + xml::escape(name) + '"';
+		xml::appendEscaped(out += " dn=\"", name) += '"';
+	}
+	if (msg.empty()) {
+		return out += "/>";
 	}
+	return xml::appendEscaped(out += '>', msg) += "</st>";
+}
+
 
-	return packet + (msg.empty() ? "/>" : ('>' + xml::escape(msg) + "</st>"));
+std::string::size_type mLength(const std::string &msg, unsigned flags) {
+	return 7 + xml::escapedLength(msg) +
+		(flags & sig::MessageData::ACTION ? 8 : 0) +
+		(flags & sig::MessageData::MESSAGE ? 10 : 0);
 }
 
 
-std::string m(const std::string &msg, unsigned flags) {
-	std::string packet("<m");
+std::string &appendM(std::string &out, const std::string &msg,
+                     unsigned flags) {
+	out += "<m";
 	if (flags & sig::MessageData::ACTION) {
-		packet.append(" ac=\"ac\"");
+		out += " ac=\"ac\"";
 	}
 	if (flags & sig::MessageData::MESSAGE) {
-		packet.append(" msg=\"msg\"");
+		out += " msg=\"msg\"";
 	}
-	return packet + '>' + xml::escape(msg) + "</m>";
+	return xml::appendEscaped(out += '>', msg) += "</m>";
 }
 
 
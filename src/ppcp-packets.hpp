@@ -30,12 +30,46 @@ namespace ppc {
 namespace ppcp {
 
 
+/*
+ * Each packet has three kinds of functions: one returning packet's
+ * length, one appending packet to a string and one returning packet
+ * as a new string.  To compose several packets without temporary
+ * strings sum their lengths, reserve space in output buffer and
+ * append packets one after another.
+ */
+
+
 /**
- * Returns a \c ppcp open tag.
+ * Returns length of \c ppcp open tag.
  * \param user user object.
+ * \param to   value of \c to:n attribute (or empty string).
+ * \param neg  if \c true \c to:neg will be set to \c "neg".
  */
-std::string ppcpOpen(const User &user);
+std::string::size_type ppcpOpenLength(const User &user,
+                                      const std::string &to = std::string(),
+                                      bool neg = false);
 
+/**
+ * Appends a \c ppcp open tag to \a out.
+ * \param out  string to append packet to.
+ * \param user user object.
+ * \param to   value of \c to:n attribute (or empty string).
+ * \param neg  if \c true \c to:neg will be set to \c "neg".
+ * \return reference to \a out.
+ */
+std::string &appendPpcpOpen(std::string &out, const User &user,
+                            const std::string &to = std::string(),
+                            bool neg = false);
+
+/**
+ * Returns a \c ppcp open tag.
+ * \param user user object.
+ */
+inline std::string ppcpOpen(const User &user) {
+	std::string packet;
+	packet.reserve(ppcpOpenLength(user));
+	return appendPpcpOpen(packet, user);
+}
 
 /**
  * Returns a \c ppcp open tag.
@@ -43,7 +77,12 @@ std::string ppcpOpen(const User &user);
  * \param to   value of \c to:n attribute (or empty string).
  * \param neg  if \c true \c to:neg will be set to \c "neg".
  */
-std::string ppcpOpen(const User &user, const std::string &to, bool neg=false);
+inline std::string ppcpOpen(const User &user, const std::string &to,
+                            bool neg=false) {
+	std::string packet;
+	packet.reserve(ppcpOpenLength(user, to, neg));
+	return appendPpcpOpen(packet, user, to, neg);
+}
 
 
 /** Returns a \c ppcp close tag (that is <tt>"\</ppcp\>"</tt>). */
@@ -54,14 +93,37 @@ inline const std::string &ppcpClose() {
 
 
 /**
- * Returns a \c st element.
+ * Returns length of \c st element.
  * \param st   user's state.
  * \param msg  user's status message.
  * \param name user's display name.
  */
-std::string st(User::State st, const std::string &msg,
-               const std::string &name);
+std::string::size_type stLength(User::State st, const std::string &msg,
+                                const std::string &name);
 
+/**
+ * Appends a \c st element to \a out.
+ * \param out  string to append packet to.
+ * \param st   user's state.
+ * \param msg  user's status message.
+ * \param name user's display name.
+ * \return reference to \a out.
+ */
+std::string &appendSt(std::string &out, User::State st,
+                      const std::string &msg, const std::string &name);
+
+/**
+ * Returns a \c st element.
+ * \param st   user's state.
+ * \param msg  user's status message.
+ * \param name user's display name.
+ */
+inline std::string st(User::State st, const std::string &msg,
+                      const std::string &name) {
+	std::string packet;
+	packet.reserve(stLength(st, msg, name));
+	return appendSt(packet, st, msg, name);
+}
 
 /**
  * Returns a \c st element.
@@ -81,13 +143,35 @@ inline const std::string &rq() {
 
 
 /**
- * Returns a \c m element.
+ * Returns length of \c m element.
+ * \param msg   message's body.
+ * \param flags combination of sig::MessageData::MESSAGE and
+ *              sig::MessageData::ACTION flags.
+ */
+std::string::size_type mLength(const std::string &msg, unsigned flags);
+
+/**
+ * Appends a \c m element to \a out.
+ * \param out   string to append packet to.
  * \param msg   message's body.
  * \param flags combination of sig::MessageData::MESSAGE and
  *              sig::MessageData::ACTION flags.
+ * \return reference to \a out.
  */
-std::string m(const std::string &msg, unsigned flags);
+std::string &appendM(std::string &out, const std::string &msg,
+                     unsigned flags);
 
+/**
+ * Returns a \c m element.
+ * \param msg   message's body.
+ * \param flags combination of sig::MessageData::MESSAGE and
+ *              sig::MessageData::ACTION flags.
+ */
+inline std::string m(const std::string &msg, unsigned flags) {
+	std::string packet;
+	packet.reserve(mLength(msg, flags));
+	return appendM(packet, msg, flags);
+}
 
 /**
  * Returns a \c m element.
@@ -98,6 +182,81 @@ inline std::string m(const sig::MessageData &msg) {
 }
 
 
+
+/**
+ * Body of a packet, that is what goes between \c ppcp opening and
+ * closing tags.  It is either one or two preformatted strings or an
+ * \c m element which is built directly into output buffer.  Payload
+ * only references strings it was given so they must outlive it.
+ */
+struct Payload {
+	/**
+	 * Creates payload consisting of a preformatted string.
+	 * \param str string.
+	 */
+	Payload(const std::string &str)
+		: first(&str), second(0), flags(0), message(false) { }
+
+	/**
+	 * Creates payload consisting of two preformatted strings.
+	 * \param str  first string.
+	 * \param str2 second string.
+	 */
+	Payload(const std::string &str, const std::string &str2)
+		: first(&str), second(&str2), flags(0), message(false) { }
+
+	/**
+	 * Creates payload consisting of a \c m element.
+	 * \param msg   message's body.
+	 * \param flags combination of sig::MessageData::MESSAGE and
+	 *              sig::MessageData::ACTION flags.
+	 */
+	static Payload m(const std::string &msg, unsigned flags) {
+		Payload payload(msg);
+		payload.flags = flags;
+		payload.message = true;
+		return payload;
+	}
+
+	/**
+	 * Creates payload consisting of a \c m element.
+	 * \param msg message.
+	 */
+	static Payload m(const sig::MessageData &msg) {
+		return m(msg.data, msg.flags);
+	}
+
+	/** Returns payload's length. */
+	std::string::size_type length() const {
+		return message ? mLength(*first, flags)
+			: first->length() + (second ? second->length() : 0);
+	}
+
+	/**
+	 * Appends payload to \a out.
+	 * \param out string to append payload to.
+	 * \return reference to \a out.
+	 */
+	std::string &appendTo(std::string &out) const {
+		if (message) {
+			return appendM(out, *first, flags);
+		}
+		out += *first;
+		return second ? out += *second : out;
+	}
+
+private:
+	/** First string or message's body. */
+	const std::string *first;
+	/** Second string or \c NULL. */
+	const std::string *second;
+	/** Message's flags. */
+	unsigned flags;
+	/** Whether payload is a \c m element. */
+	bool message;
+};
+
+
 }
 }
 
@@ -20,8 +20,10 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ppcp-parser.hpp"
+#include "xml-scan.hpp"
 
 
 namespace ppc {
@@ -56,9 +58,87 @@ enum {
 };
 
 
+/**
+ * Element or attribute name known to the tokenizer.  Names are kept
+ * in a perfect hash table (see nameHash()) so classifying element or
+ * attribute takes a single lookup and comparison.
+ */
+struct Name {
+	/** Name. */
+	char name[7];
+	/** Name's length; zero for unused slots. */
+	unsigned char length;
+	/** Element this name denotes or \c E_START if none. */
+	unsigned char element;
+	/**
+	 * Attribute this name denotes, indexed by element the attribute
+	 * is found in (E_PPCP, E_ST, E_RQ and E_M respectively).
+	 */
+	unsigned char attributes[4];
+};
+
+
+/**
+ * Hash function for names.  It has no collisions for names listed in
+ * names table.  If a name is added the function and the table may
+ * need to be regenerated.
+ * \param data   name (must not be empty).
+ * \param length name's length.
+ * \return slot in names table.
+ */
+static inline unsigned nameHash(const char *data,
+                                std::string::size_type length) {
+	return (length + (unsigned char)data[0] +
+	        ((unsigned char)data[length - 1] << 2)) & 15;
+}
+
+
+/** Perfect hash table of names, indexed with nameHash(). */
+static const Name names[16] = {
+	/*  0 */ { "to:n",   4, E_START, { A_PPCP_TO_N,   0, 0, 0 } },
+	/*  1 */ { "p",      1, E_START, { A_PPCP_P,      0, 0, 0 } },
+	/*  2 */ { "m",      1, E_M,     { 0,             0, 0, 0 } },
+	/*  3 */ { "",       0, E_START, { 0,             0, 0, 0 } },
+	/*  4 */ { "ppcp",   4, E_PPCP,  { 0,             0, 0, 0 } },
+	/*  5 */ { "st",     2, E_ST,    { 0,       A_ST_ST, 0, 0 } },
+	/*  6 */ { "to:neg", 6, E_START, { A_PPCP_TO_NEG, 0, 0, 0 } },
+	/*  7 */ { "n",      1, E_START, { A_PPCP_N,      0, 0, 0 } },
+	/*  8 */ { "rq",     2, E_RQ,    { 0, 0,       A_RQ_RQ, 0 } },
+	/*  9 */ { "",       0, E_START, { 0,             0, 0, 0 } },
+	/* 10 */ { "",       0, E_START, { 0,             0, 0, 0 } },
+	/* 11 */ { "",       0, E_START, { 0,             0, 0, 0 } },
+	/* 12 */ { "msg",    3, E_START, { 0, 0, 0,       A_M_MSG } },
+	/* 13 */ { "",       0, E_START, { 0,             0, 0, 0 } },
+	/* 14 */ { "dn",     2, E_START, { 0,       A_ST_DN, 0, 0 } },
+	/* 15 */ { "ac",     2, E_START, { 0, 0, 0,        A_M_AC } }
+};
+
+
+/**
+ * Looks name up in names table.
+ * \param slice name to look for.
+ * \return matching entry or an empty entry if name is unknown.
+ */
+static inline const Name &lookupName(const xml::Tokenizer::Slice &slice) {
+	if (!slice.length || slice.length > 6) {
+		return names[3];
+	}
+	const Name &name = names[nameHash(slice.data, slice.length)];
+	return name.length == slice.length &&
+		!memcmp(name.name, slice.data, slice.length) ? name : names[3];
+}
+
+
 
 
 void Tokenizer::init() {
+#ifndef NDEBUG
+	for (unsigned i = 0; i < sizeof names / sizeof *names; ++i) {
+		assert(!names[i].length ||
+		       nameHash(names[i].name, names[i].length) == i);
+	}
+#endif
+
 	element = E_START;
 	ignore = 0;
 	data.clear();
@@ -67,15 +147,20 @@ void Tokenizer::init() {
 
 
 
-Tokenizer::Token Tokenizer::nextToken(const xml::Tokenizer::Token &xToken) {
+void Tokenizer::nextToken(const xml::Tokenizer::TokenView &xToken,
+                          Token &token) {
+	token.type = END;
+	token.flags = 0;
+	token.data.clear();
+	token.data2.clear();
+
 	if (element==E_IGNORE) {
-		return Token(IGNORE);
+		token.type = IGNORE;
+		return;
 	}
 
-
-	Token token;
 	if (!xToken) {
-		return token;
+		return;
 	}
 
 
@@ -86,7 +171,7 @@ Tokenizer::Token Tokenizer::nextToken(const xml::Tokenizer::Token &xToken) {
 		} else if (xToken.type == xml::Tokenizer::ELEMENT_CLOSE) {
 			--ignore;
 		}
-		return token;
+		return;
 	}
 
 
@@ -100,22 +185,27 @@ Tokenizer::Token Tokenizer::nextToken(const xml::Tokenizer::Token &xToken) {
 		data2.clear();
 		switch (element) {
 		case E_START:
-			if (xToken.data != "ppcp") goto ignore_rest;
+			if (lookupName(xToken.data).element != E_PPCP) goto ignore_rest;
 			element = E_PPCP;
 			break;
 
 		case E_PPCP:
 			flags = 0;
-			if (xToken.data == "st") {
+			switch (lookupName(xToken.data).element) {
+			case E_ST:
 				flags = (unsigned short)User::ONLINE;
 				element = E_ST;
-			} else if (xToken.data == "rq") element = E_RQ;
-			else if (xToken.data == "m") element = E_M;
-			else {
+				break;
+			case E_RQ: element = E_RQ; break;
+			case E_M : element = E_M ; break;
+			default  : ignore = 1;
+			}
+			break;
+
 		case E_ST:
 		case E_RQ:
-		case E_M: ignore = 1;
-			}
+		case E_M:
+			ignore = 1;
 			break;
 
 		default:
@@ -132,32 +222,8 @@ Tokenizer::Token Tokenizer::nextToken(const xml::Tokenizer::Token &xToken) {
 		/* Attribute */
 	case xml::Tokenizer::ATTR_NAME:
 		/* Change state depending on attribute name */
-		attribute = A_UNKNOWN;
-		switch (element) {
-		case E_PPCP:
-			if (xToken.data == "n") attribute = A_PPCP_N;
-			else if (xToken.data == "p") attribute = A_PPCP_P;
-			else if (xToken.data == "to:n") attribute = A_PPCP_TO_N;
-			else if (xToken.data == "to:neg") attribute = A_PPCP_TO_NEG;
-			break;
-
-		case E_ST:
-			if (xToken.data == "st") attribute = A_ST_ST;
-			else if (xToken.data == "dn") attribute = A_ST_DN;
-			break;
-
-		case E_RQ:
-			if (xToken.data == "rq") attribute = A_RQ_RQ;
-			break;
-
-		case E_M:
-			if (xToken.data == "msg") attribute = A_M_MSG;
-			else if (xToken.data == "ac") attribute = A_M_AC;
-			break;
-
-		default:
-			assert(0);
-		}
+		assert(element >= E_PPCP && element <= E_M);
+		attribute = lookupName(xToken.data).attributes[element - E_PPCP];
 		break;
 
 
@@ -165,12 +231,12 @@ Tokenizer::Token Tokenizer::nextToken(const xml::Tokenizer::Token &xToken) {
 	case xml::Tokenizer::ATTR_VALUE:
 		switch (attribute) {
 		case A_PPCP_N:
-			data = xToken.data;
+			data.assign(xToken.data.data, xToken.data.length);
 			break;
 
 		case A_PPCP_P:
 		case A_ST_DN:
-			data2 = xToken.data;
+			data2.assign(xToken.data.data, xToken.data.length);
 			break;
 
 		case A_PPCP_TO_N:
@@ -187,7 +253,7 @@ Tokenizer::Token Tokenizer::nextToken(const xml::Tokenizer::Token &xToken) {
 
 		case A_ST_ST: {
 			bool valid = true;
-			enum User::State state = User::getState(xToken.data, valid);
+			enum User::State state = User::getState(xToken.data.str(), valid);
 			if (valid) flags = (unsigned short)state;
 		}
 			break;
@@ -253,7 +319,7 @@ Tokenizer::Token Tokenizer::nextToken(const xml::Tokenizer::Token &xToken) {
 		/* Text */
 	case xml::Tokenizer::TEXT:
 		if (element == E_ST || element == E_M) {
-			data = xToken.data;
+			data.assign(xToken.data.data, xToken.data.length);
 		}
 		break;
 
@@ -295,22 +361,553 @@ Tokenizer::Token Tokenizer::nextToken(const xml::Tokenizer::Token &xToken) {
 	default:
 		assert(0);
 	}
+}
+
+
+
+void Tokenizer::nextToken(xml::Tokenizer &tokenizer, Token &token) {
+	if (element == E_IGNORE) {
+		while (tokenizer.nextTokenView());
+		nextToken(xml::Tokenizer::TokenView(), token);
+	} else {
+		xml::Tokenizer::TokenView xToken;
+		do {
+			xToken = tokenizer.nextTokenView();
+			nextToken(xToken, token);
+		} while (xToken && !token);
+	}
+}
+
+
+
+/********************  DirectTokenizer  ********************/
+
+/** XML parser's states, \see xml::Tokenizer::nextTokenView(). */
+enum {
+	S_START,          /**< We're starting */
+	S_CDATA,          /**< Inside cdata */
+	S_TAG,            /**< Inside tag, reading element name */
+	S_TAG_INSIDE,     /**< Inside open tag, waiting for attribute or end */
+	S_TAG_CLOSING,    /**< Inside close tag, waiting for '>' */
+	S_ATTR,           /**< Reading attribute name */
+	S_ATTR_GOT_NAME,  /**< Got attribute name, waiting for '=' */
+	S_ATTR_GOT_EQ,    /**< Got arg name and '=', waiting for '"' */
+	S_ATTR_RD_VALUE   /**< Reading attribute value, waiting for '"' */
+};
+
+
+void DirectTokenizer::init() {
+	element = E_START;
+	attribute = A_UNKNOWN;
+	flags = 0;
+	ignore = 0;
+	data.clear();
+	data2.clear();
+
+	state = S_START;
+	popPending = false;
+	stackNames.clear();
+	stackOffsets.clear();
+	buffer.clear();
+	pos = dataStart = reserved = 0;
+}
+
+
+
+void DirectTokenizer::nextToken(Tokenizer::Token &token) {
+	token.type = Tokenizer::END;
+	token.flags = 0;
+	token.data.clear();
+	token.data2.clear();
+
+	if (element == E_IGNORE) {
+		while (step(token));
+		token.type = Tokenizer::IGNORE;
+	} else {
+		while (!token && step(token));
+	}
+}
+
+
+
+bool DirectTokenizer::step(Tokenizer::Token &token) {
+	std::string::size_type p;
+	const char *it;
+
+	if (popPending) {
+		stackNames.resize(stackOffsets.back());
+		stackOffsets.pop_back();
+		popPending = false;
+	}
+
+	if (pos >= buffer.length()) {
+		return false;
+	}
+
+	const char *const buf = buffer.data();
+	const char *const end = buf + buffer.length();
+	const xml::Scanner &scan = xml::Scanner::best();
+
+
+	switch (state) {
+		/* We're starting. */
+	case S_START:
+		it = scan.skipSpaces(buf + pos, end);
+		if (it == end) {
+			buffer.clear();
+			pos = 0;
+			return false;
+		}
+
+		if (*it != '<') {
+			throw xml::Error("Expecting root element.");
+		}
+		p = it - buf;
+		goto state_tag;
+
+
+		/* Inside CDATA. */
+	case S_CDATA:
+		it = scan.findTagDelimiter(buf + pos, end);
+		if (it == end) {
+			goto shorten_buffer;
+		}
+
+		if (*it == '>') {
+			throw xml::Error("Unexpected '>'.");
+		}
+
+		p = it - buf;
+		if (p != dataStart) {
+			text(Slice(buf + dataStart, p - dataStart));
+			state = S_TAG;
+			dataStart = pos = p + 1;
+			return true;
+		}
+
+		/* FALL THROUGH */
+
+
+		/* Just after '<', reading element name. */
+	state_tag:
+		state = S_TAG;
+		dataStart = pos = p + 1;
+		/* FALL THROUGH */
+	case S_TAG: {
+		it = buf + pos;
+		if (dataStart == pos && it != end && *it == '/') ++it;
+		it = scan.skipNameChars(it, end);
+		if (it == end) {
+			goto shorten_buffer;
+		}
+
+		pos = it - buf;
+		if (pos == dataStart || (pos-dataStart == 1 && buf[dataStart] == '/')) {
+			throw xml::Error("Expecting element name.");
+		}
+
+		/* It's opening tag */
+		if (buf[dataStart] != '/') {
+			const Slice name(buf + dataStart, pos - dataStart);
+			state = S_TAG_INSIDE;
+			stackOffsets.push_back(stackNames.length());
+			stackNames.append(name.data, name.length);
+			open(name, token);
+			return true;
+		}
+
+		/* It's a closing tag */
+		const Slice name(buf + dataStart + 1, pos - dataStart - 1);
+		if (stackOffsets.empty()) {
+			throw xml::Error("Closing '" + name.str() +
+			                 "' where no element open.");
+		}
+
+		const Slice open(stackNames.data() + stackOffsets.back(),
+		                 stackNames.length() - stackOffsets.back());
+		if (open != name) {
+			throw xml::Error("Closing '" + name.str() + "' where '" +
+			                 open.str() + "' open.");
+		}
+
+		state = S_TAG_CLOSING;
+	}
+
+
+		/* It's a closing tag or opening after '/' char; waiting for '>'. */
+		/* FALL THROUGH */
+	case S_TAG_CLOSING:
+		it = scan.skipSpaces(buf + pos, end);
+		if (it == end) {
+			buffer.clear();
+			pos = 0;
+			return false;
+		}
+
+		if (*it != '>') {
+			throw xml::Error("Expecting '>'");
+		}
+
+		popPending = true;
+		state = stackOffsets.size() == 1 ? S_START : S_CDATA;
+		dataStart = pos = it - buf + 1;
+		close(token);
+		return true;
+
+
+		/* It's opening tag and we have read element name. */
+	case S_TAG_INSIDE:
+		it = scan.skipSpaces(buf + pos, end);
+		if (it == end) {
+			buffer.clear();
+			pos = 0;
+			return false;
+		}
+
+		pos = it - buf + 1;
+		if (*it == '/') {
+			state = S_TAG_CLOSING;
+			tagClose(token);
+			return true;
+		} else if (*it == '>') {
+			dataStart = pos;
+			state = S_CDATA;
+			tagClose(token);
+			return true;
+		} else if (!xml::isNameChar(*it)) {
+			throw xml::Error("Expecting '/', '>' or attribute name.");
+		}
+
+		state = S_ATTR;
+		dataStart = pos - 1;
+
+
+		/* We are reading attribute name. */
+		/* FALL THROUGH */
+	case S_ATTR:
+		it = scan.skipNameChars(buf + pos, end);
+		if (it == end) {
+			goto shorten_buffer;
+		}
+
+		pos = it - buf;
+		if (pos == dataStart) {
+			throw xml::Error("Expecting attribute name.");
+		}
+
+		state = S_ATTR_GOT_NAME;
+		attributeName(Slice(buf + dataStart, pos - dataStart));
+		return true;
+
+
+		/* Got attribute name, waiting for '='. */
+	case S_ATTR_GOT_NAME:
+		it = scan.skipSpaces(buf + pos, end);
+		if (it == end) {
+			buffer.clear();
+			pos = 0;
+			return false;
+		}
+
+		if (*it != '=') {
+			throw xml::Error("Expecting '='.");
+		}
+
+		pos = it - buf + 1;
+		state = S_ATTR_GOT_EQ;
+
+
+		/* Got attribute name and '=', waiting for '"'. */
+		/* FALL THROUGH */
+	case S_ATTR_GOT_EQ:
+		it = scan.skipSpaces(buf + pos, end);
+		if (it == end) {
+			buffer.clear();
+			pos = 0;
+			return false;
+		}
+
+		if (*it != '"') {
+			throw xml::Error("Expecting '\"'.");
+		}
+
+		dataStart = pos = it - buf + 1;
+		state = S_ATTR_RD_VALUE;
+
+
+		/* Got attribute name, reading value. */
+		/* FALL THROUGH */
+	case S_ATTR_RD_VALUE:
+		it = scan.findValueDelimiter(buf + pos, end);
+		if (it == end) {
+			goto shorten_buffer;
+		}
+
+		if (*it != '"') {
+			throw xml::Error("Expecting '\"'");
+		}
+
+		p = it - buf;
+		attributeValue(Slice(buf + dataStart, p - dataStart));
+		state = S_TAG_INSIDE;
+		pos = p + 1;
+		return true;
+
+	default:
+		assert(0);
+	}
+
+
+ shorten_buffer:
+	pos = buffer.length();
+	return false;
+}
+
+
+
+void DirectTokenizer::open(const Slice &name, Tokenizer::Token &token) {
+	if (element == E_IGNORE) {
+		return;
+	}
+	if (ignore) {
+		++ignore;
+		return;
+	}
+
+	attribute = A_UNKNOWN;
+	flags = 0;
+	data.clear();
+	data2.clear();
+
+	switch (element) {
+	case E_START:
+		if (lookupName(name).element != E_PPCP) {
+			ignoreRest(token);
+		} else {
+			element = E_PPCP;
+		}
+		break;
+
+	case E_PPCP:
+		switch (lookupName(name).element) {
+		case E_ST:
+			flags = (unsigned short)User::ONLINE;
+			element = E_ST;
+			break;
+		case E_RQ: element = E_RQ; break;
+		case E_M : element = E_M ; break;
+		default  : ignore = 1;
+		}
+		break;
+
+	case E_ST:
+	case E_RQ:
+	case E_M:
+		ignore = 1;
+		break;
+
+	default:
+		assert(0);
+	}
+}
+
+
+void DirectTokenizer::attributeName(const Slice &name) {
+	if (element == E_IGNORE || ignore) {
+		return;
+	}
+	assert(element >= E_PPCP && element <= E_M);
+	attribute = lookupName(name).attributes[element - E_PPCP];
+}
+
+
+void DirectTokenizer::attributeValue(const Slice &raw) {
+	if (element == E_IGNORE || ignore) {
+		unescape(raw);
+		return;
+	}
+
+	switch (attribute) {
+	case A_PPCP_N:
+		xml::unescapeInPlace(data.assign(raw.data, raw.length));
+		break;
+
+	case A_PPCP_P:
+	case A_ST_DN:
+		xml::unescapeInPlace(data2.assign(raw.data, raw.length));
+		break;
+
+	default: {
+		const Slice value = unescape(raw);
+		switch (attribute) {
+		case A_PPCP_TO_N:
+			flags = (flags & ~F_PPCP_TO_N_OK) | F_PPCP_TO_N;
+			if (value == ourNick) {
+				flags |= F_PPCP_TO_N_OK;
+			}
+			break;
+
+		case A_PPCP_TO_NEG:
+			/* Tokenizer compares "n" attribute's value here; do the
+			   same so both give identical results. */
+			flags &= ~F_PPCP_TO_NEG;
+			if (data == "neg") flags |= F_PPCP_TO_NEG;
+			break;
+
+		case A_ST_ST: {
+			bool valid = true;
+			enum User::State st = User::getState(value.str(), valid);
+			if (valid) flags = (unsigned short)st;
+		}
+			break;
+
+		case A_M_MSG:
+			if (value == "msg") flags |= Tokenizer::Token::M_MESSAGE;
+			break;
+
+		case A_M_AC:
+			if (value == "ac") flags |= Tokenizer::Token::M_ACTION;
+			break;
+
+		case A_RQ_RQ:
+			flags = value != "st";
+			break;
+
+		case A_UNKNOWN:
+			break;
+
+		default:
+			assert(0);
+		}
+	}
+	}
 
-	return token;
+	attribute = A_UNKNOWN;
 }
 
 
+void DirectTokenizer::tagClose(Tokenizer::Token &token) {
+	if (element != E_PPCP || ignore) {
+		return;
+	}
+
+	if ((flags & F_PPCP_TO_N &&
+	     (!(flags & F_PPCP_TO_N_OK) == !(flags & F_PPCP_TO_NEG))) ||
+	    data2.empty() || !User::isValidName(data)) {
+		ignoreRest(token);
+		return;
+	}
+
+	unsigned long port;
+	char *end;
+	errno = 0;
+	port = strtoul(data2.c_str(), &end, 10);
+	if (errno || port<1024 || port>65535 || *end) {
+		ignoreRest(token);
+		return;
+	}
+	token.flags = port;
 
-Tokenizer::Token Tokenizer::nextToken(xml::Tokenizer &tokenizer) {
+	data = User::nickFromName(data2 = data);
+	if (ourPort.host() == token.flags && data == ourNick) {
+		ignoreRest(token);
+		return;
+	}
+
+	token.type = Tokenizer::PPCP_OPEN;
+	token.data.swap(data);
+	token.data2.swap(data2);
+	data.clear();
+}
+
+
+void DirectTokenizer::text(const Slice &raw) {
+	if (element != E_IGNORE && !ignore &&
+	    (element == E_ST || element == E_M)) {
+		xml::unescapeInPlace(data.assign(raw.data, raw.length));
+	} else {
+		unescape(raw);
+	}
+}
+
+
+void DirectTokenizer::close(Tokenizer::Token &token) {
 	if (element == E_IGNORE) {
-		while (tokenizer.nextToken());
-		return Token(IGNORE);
+		return;
+	}
+	if (ignore) {
+		--ignore;
+		return;
+	}
+
+	switch (element) {
+	case E_PPCP:
+		token.type = Tokenizer::PPCP_CLOSE;
+		element = E_IGNORE;
+		break;
+
+	case E_ST:
+		token.type = Tokenizer::ST;
+		token.data.swap(data);
+		token.data2.swap(data2);
+		token.flags = flags;
+		element = E_PPCP;
+		break;
+
+	case E_RQ:
+		if (!flags) token.type = Tokenizer::RQ;
+		element = E_PPCP;
+		break;
+
+	case E_M:
+		token.type = Tokenizer::M;
+		token.data.swap(data);
+		token.flags = flags;
+		element = E_PPCP;
+		break;
+
+	default:
+		assert(0);
+	}
+}
+
+
+void DirectTokenizer::ignoreRest(Tokenizer::Token &token) {
+	token.type = Tokenizer::IGNORE;
+	element = E_IGNORE;
+	data.clear();
+	data2.clear();
+}
+
+
+DirectTokenizer::Slice DirectTokenizer::unescape(const Slice &raw) {
+	if (!memchr(raw.data, '&', raw.length)) {
+		return raw;
+	}
+	unescaped.assign(raw.data, raw.length);
+	return Slice(xml::unescapeInPlace(unescaped));
+}
+
+
+void DirectTokenizer::compact() {
+	const std::string::size_type consumed = dataStart < pos ? dataStart : pos;
+	const std::string::size_type length = buffer.length();
+
+	if (consumed == length) {
+		buffer.clear();
+		pos = dataStart = 0;
+	} else if (consumed >= PPC_XML_COMPACT_MIN &&
+	           consumed >= length - consumed) {
+		buffer.erase(0, consumed);
+		pos -= consumed;
+		dataStart -= consumed;
 	} else {
-		xml::Tokenizer::Token xToken;
-		Token pToken;
-		while ((xToken = tokenizer.nextToken()) &&
-		       !(pToken = nextToken(xToken)));
-		return pToken;
+		return;
+	}
+
+	if (buffer.capacity() > PPC_XML_BUFFER_HIGH_WATER &&
+	    buffer.length() < buffer.capacity() / 4) {
+		std::string(buffer).swap(buffer);
 	}
 }
 
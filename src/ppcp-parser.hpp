@@ -20,6 +20,7 @@
 #define H_PPCP_PARSER_HPP
 
 #include <string>
+#include <vector>
 
 #include "xml-parser.hpp"
 #include "user.hpp"
@@ -166,7 +167,21 @@ struct Tokenizer {
 	 * a \c END token.
 	 * \param token token to consume.
 	 */
-	Token nextToken(const xml::Tokenizer::Token &token);
+	Token nextToken(const xml::Tokenizer::Token &token) {
+		Token pToken;
+		nextToken(xml::Tokenizer::TokenView(token.type, token.data), pToken);
+		return pToken;
+	}
+
+	/**
+	 * Takes given XML token and stores next PPCP token (which may be
+	 * a \c END token) in \a token.  Strings in \a token are reused so
+	 * if it is the same object each time there is no need to allocate
+	 * memory.
+	 * \param xToken token to consume.
+	 * \param token  object to store PPCP token in.
+	 */
+	void nextToken(const xml::Tokenizer::TokenView &xToken, Token &token);
 
 
 	/**
@@ -174,7 +189,20 @@ struct Tokenizer {
 	 * END token or there is new PPCP token.
 	 * \param tokenizer XML tokenizer to consume tokens from.
 	 */
-	Token nextToken(xml::Tokenizer &tokenizer);
+	Token nextToken(xml::Tokenizer &tokenizer) {
+		Token token;
+		nextToken(tokenizer, token);
+		return token;
+	}
+
+	/**
+	 * Consumes tokens from \a tokenizer until either tokenizer gives
+	 * END token or there is new PPCP token which is stored in \a
+	 * token.  XML tokens are not copied out of tokenizer's buffer.
+	 * \param tokenizer XML tokenizer to consume tokens from.
+	 * \param token     object to store PPCP token in.
+	 */
+	void nextToken(xml::Tokenizer &tokenizer, Token &token);
 
 
 
@@ -202,6 +230,210 @@ private:
 
 
 
+/**
+ * PPCP tokenizer which parses packets directly from bytes without
+ * going through xml::Tokenizer's tokens.  It accepts the same XML,
+ * throws the same errors and gives the same tokens as Tokenizer fed
+ * by xml::Tokenizer but reads data only once and unescapes values
+ * straight into tokens.  Like xml::Tokenizer it may be fed with data
+ * in arbitrary chunks.
+ */
+struct DirectTokenizer {
+	/**
+	 * Constructs tokenizer.  \see Tokenizer::Tokenizer(const
+	 * std::string&, Port)
+	 *
+	 * \param nick our nick name.
+	 * \param port port number to compare against \c p attribute.
+	 */
+	explicit DirectTokenizer(const std::string &nick, Port port = 0)
+		: ourNick(nick), ourPort(port) { init(); }
+
+	/**
+	 * Constructs tokenizer.  \see Tokenizer::Tokenizer(const
+	 * User::ID&)
+	 *
+	 * \param id User::ID object including with nick name and port number.
+	 */
+	explicit DirectTokenizer(const User::ID &id)
+		: ourNick(id.nick), ourPort(id.address.port) { init(); }
+
+
+	/**
+	 * Zeroe's tokenizer state.
+	 */
+	void init();
+
+	/**
+	 * Zeroe's tokenizer state and sets our port number.
+	 * \param port port number to compare against \c p attribute.
+	 */
+	void init(Port port) {
+		ourPort = port;
+		init();
+	}
+
+	/**
+	 * Feeds tokenizer with data.
+	 * \param str data to feed tokenizer with.
+	 */
+	void feed(const std::string &str) {
+		compact();
+		buffer += str;
+	}
+
+	/**
+	 * Feeds tokenizer with data.
+	 * \param str data to feed tokenizer with.
+	 */
+	void feed(const char *str) {
+		compact();
+		buffer += str;
+	}
+
+	/**
+	 * Feeds tokenizer with data.
+	 * \param str data to feed tokenizer with.
+	 * \param len data's length.
+	 */
+	void feed(const char *str, std::string::size_type len) {
+		compact();
+		buffer.append(str, len);
+	}
+
+	/**
+	 * Reserves space at the end of tokenizer's buffer.
+	 * \param len number of bytes to reserve.
+	 * \return pointer to \a len writable bytes.
+	 * \see xml::Tokenizer::reserve()
+	 */
+	char *reserve(std::string::size_type len) {
+		compact();
+		reserved = buffer.length();
+		buffer.resize(reserved + len);
+		return &buffer[reserved];
+	}
+
+	/**
+	 * Feeds tokenizer with data written to reserved space.
+	 * \param len number of bytes written.
+	 * \see xml::Tokenizer::commit()
+	 */
+	void commit(std::string::size_type len) {
+		buffer.resize(reserved + len);
+	}
+
+	/**
+	 * Returns next token, \c END if there are no more tokens.
+	 * \throw xml::Error if data is missformatted.
+	 */
+	Tokenizer::Token nextToken() {
+		Tokenizer::Token token;
+		nextToken(token);
+		return token;
+	}
+
+	/**
+	 * Stores next token (\c END if there are no more tokens) in \a
+	 * token.
+	 * \param token object to store token in.
+	 * \throw xml::Error if data is missformatted.
+	 */
+	void nextToken(Tokenizer::Token &token);
+
+	/**
+	 * If tokenizer expects more data exreption is thrown otherwise no
+	 * action is taken.
+	 * \throw xml::Error if tokenizer is in state that does not allow
+	 *                   end of data.
+	 */
+	void done() {
+		if (stackOffsets.size() - popPending || state || !buffer.empty()) {
+			throw xml::Error("Unexpected end of data.");
+		}
+	}
+
+
+private:
+	/** Shortcut for slice type. */
+	typedef xml::Tokenizer::Slice Slice;
+
+	/** Our user's nick name. */
+	std::string ourNick;
+	/** Our port number to compare agains \c p attribute. */
+	Port ourPort;
+
+	/** Current element. */
+	unsigned char element;
+	/** Current attribute. */
+	unsigned char attribute;
+	/** Current state flags. */
+	unsigned short flags;
+	/** Whether element should be ignored and how many levels deep. */
+	unsigned ignore;
+
+	/** Holds content of \c st or \c m elements or \c n attribute of
+	    \c ppcp element. */
+	std::string data;
+	/** Holds content of \c dn attribute of \c ppcp element. */
+	std::string data2;
+
+	/** XML parser's state. */
+	unsigned state;
+	/** Whether the deepest element was closed. */
+	bool popPending;
+	/** Names of opened elements concatenated together. */
+	std::string stackNames;
+	/** Offsets of opened elements' names in stackNames. */
+	std::vector<std::string::size_type> stackOffsets;
+
+	/** Unescaped value of attribute if it contained entities. */
+	std::string unescaped;
+
+	std::string buffer;               /**< Internal buffer. */
+	std::string::size_type pos;       /**< Internal variable. */
+	std::string::size_type dataStart; /**< Internal variable. */
+	std::string::size_type reserved;  /**< Length before reserve(). */
+
+
+	/**
+	 * Parses data till the next XML token and handles it.
+	 * \param token object to store PPCP token in if there is one.
+	 * \return \c false if more data is needed.
+	 * \throw xml::Error if data is missformatted.
+	 */
+	bool step(Tokenizer::Token &token);
+
+	/** Handles opening tag of element named \a name. */
+	void open(const Slice &name, Tokenizer::Token &token);
+	/** Handles attribute's name. */
+	void attributeName(const Slice &name);
+	/** Handles attribute's value (\a raw is not unescaped yet). */
+	void attributeValue(const Slice &raw);
+	/** Handles end of opening tag. */
+	void tagClose(Tokenizer::Token &token);
+	/** Handles text (\a raw is not unescaped yet). */
+	void text(const Slice &raw);
+	/** Handles end of element. */
+	void close(Tokenizer::Token &token);
+	/** Marks rest of the packet as ignored. */
+	void ignoreRest(Tokenizer::Token &token);
+
+	/**
+	 * If \a raw contains entities unescapes it into \a unescaped
+	 * buffer.
+	 * \param raw slice to unescape.
+	 * \return \a raw or slice pointing to \a unescaped.
+	 * \throw xml::Error if data is missformatted.
+	 */
+	Slice unescape(const Slice &raw);
+
+	/** \see xml::Tokenizer::compact() */
+	void compact();
+};
+
+
+
 /**
  * A stand alone PPCP tokenizer which does not need a separate XML
  * tokenizer object since it has it built in.
@@ -218,7 +450,8 @@ struct StandAloneTokenizer {
 	 * \param port port number to compare against \c p attribute.
 	 */
 	explicit StandAloneTokenizer(const std::string &nick, Port port = 0)
-		: ppcpTokenizer(nick, port) { }
+		: ppcpTokenizer(nick, port), directTokenizer(nick, port),
+		  direct(false) { }
 
 	/**
 	 * Constructs tokenizer.  This constructor does the same \link
@@ -227,14 +460,30 @@ struct StandAloneTokenizer {
 	 *
 	 * \param id User::ID object including with nick name and port number.
 	 */
-	explicit StandAloneTokenizer(const User::ID &id) : ppcpTokenizer(id) { }
+	explicit StandAloneTokenizer(const User::ID &id)
+		: ppcpTokenizer(id), directTokenizer(id), direct(false) { }
+
+	/**
+	 * Chooses whether packets are parsed by DirectTokenizer or by
+	 * xml::Tokenizer and Tokenizer.  Both give the same tokens.
+	 * Tokenizer has to be initialised after switching.
+	 * \param d whether to use DirectTokenizer.
+	 */
+	void setDirect(bool d) { direct = d; }
+
+	/** Returns whether DirectTokenizer is used. */
+	bool isDirect() const { return direct; }
 
 	/**
 	 * Zeroe's tokenizer state.
 	 */
 	void init() {
-		ppcpTokenizer.init();
-		xmlTokenizer.init();
+		if (direct) {
+			directTokenizer.init();
+		} else {
+			ppcpTokenizer.init();
+			xmlTokenizer.init();
+		}
 	}
 
 	/**
@@ -242,8 +491,12 @@ struct StandAloneTokenizer {
 	 * \param port port number to compare against \c p attribute.
 	 */
 	void init(Port port) {
-		ppcpTokenizer.init(port);
-		xmlTokenizer.init();
+		if (direct) {
+			directTokenizer.init(port);
+		} else {
+			ppcpTokenizer.init(port);
+			xmlTokenizer.init();
+		}
 	}
 
 	/**
@@ -251,7 +504,11 @@ struct StandAloneTokenizer {
 	 * \param data data to feed tokenizer with.
 	 */
 	void feed(const std::string &data) {
-		xmlTokenizer.feed(data);
+		if (direct) {
+			directTokenizer.feed(data);
+		} else {
+			xmlTokenizer.feed(data);
+		}
 	}
 
 	/**
@@ -259,7 +516,11 @@ struct StandAloneTokenizer {
 	 * \param data data to feed tokenizer with.
 	 */
 	void feed(const char *data) {
-		xmlTokenizer.feed(data);
+		if (direct) {
+			directTokenizer.feed(data);
+		} else {
+			xmlTokenizer.feed(data);
+		}
 	}
 
 	/**
@@ -268,7 +529,35 @@ struct StandAloneTokenizer {
 	 * \param len  data's length.
 	 */
 	void feed(const char *data, std::string::size_type len) {
-		xmlTokenizer.feed(data, len);
+		if (direct) {
+			directTokenizer.feed(data, len);
+		} else {
+			xmlTokenizer.feed(data, len);
+		}
+	}
+
+	/**
+	 * Reserves space at the end of tokenizer's buffer.
+	 * \param len number of bytes to reserve.
+	 * \return pointer to \a len writable bytes.
+	 * \see xml::Tokenizer::reserve()
+	 */
+	char *reserve(std::string::size_type len) {
+		return direct ? directTokenizer.reserve(len)
+			: xmlTokenizer.reserve(len);
+	}
+
+	/**
+	 * Feeds tokenizer with data written to reserved space.
+	 * \param len number of bytes written.
+	 * \see xml::Tokenizer::commit()
+	 */
+	void commit(std::string::size_type len) {
+		if (direct) {
+			directTokenizer.commit(len);
+		} else {
+			xmlTokenizer.commit(len);
+		}
 	}
 
 	/**
@@ -276,7 +565,23 @@ struct StandAloneTokenizer {
 	 * \throw xml::Error if data is missformatted.
 	 */
 	Tokenizer::Token nextToken() {
-		return ppcpTokenizer.nextToken(xmlTokenizer);
+		Tokenizer::Token token;
+		nextToken(token);
+		return token;
+	}
+
+	/**
+	 * Stores next token (\c END if there are no more tokens) in \a
+	 * token.
+	 * \param token object to store token in.
+	 * \throw xml::Error if data is missformatted.
+	 */
+	void nextToken(Tokenizer::Token &token) {
+		if (direct) {
+			directTokenizer.nextToken(token);
+		} else {
+			ppcpTokenizer.nextToken(xmlTokenizer, token);
+		}
 	}
 
 	/**
@@ -286,7 +591,11 @@ struct StandAloneTokenizer {
 	 *                   end of data.
 	 */
 	void done() {
-		xmlTokenizer.done();
+		if (direct) {
+			directTokenizer.done();
+		} else {
+			xmlTokenizer.done();
+		}
 	}
 
 
@@ -296,6 +605,12 @@ private:
 
 	/** Underlaying xml::Tokenizer. */
 	xml::Tokenizer xmlTokenizer;
+
+	/** Tokenizer used instead of the two above if direct is set. */
+	DirectTokenizer directTokenizer;
+
+	/** Whether directTokenizer is used. */
+	bool direct;
 };
 
 
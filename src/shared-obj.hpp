@@ -179,6 +179,17 @@ struct shared_obj<const T> {
 		return *this = ptr.pointer;
 	}
 
+	/**
+	 * Exchanges pointers with other shared_obj without touching
+	 * reference counters.
+	 * \param ptr shared_obj to swap pointers with.
+	 */
+	void swap(shared_obj &ptr) {
+		T *const tmp = pointer;
+		pointer = ptr.pointer;
+		ptr.pointer = tmp;
+	}
+
 	/** Returns object pointer. */
 	const T *get() const { return pointer; }
 	/** Returns object pointer. */
@@ -0,0 +1,131 @@
+/** \file
+ * Signal names registry.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "signal.hpp"
+
+
+namespace ppc {
+
+
+/**
+ * Predefined names in order of their IDs (up to Signal::CORE_SIG,
+ * /core/sig/num names are generated).
+ */
+static const char *const predefinedNames[] = {
+	"",
+
+	"/",
+	"/core",
+	"/ui/",
+	"/net/",
+
+	"/core/tick",
+	"/core/module/new",
+	"/core/module/removed",
+	"/core/module/exits",
+	"/core/module/quit",
+	"/core/module/start",
+	"/core/module/kill",
+
+	"/ui/msg/debug",
+	"/ui/msg/info",
+	"/ui/msg/notice",
+	"/ui/msg/error",
+
+	"/net/status/changed",
+	"/net/status/change",
+	"/net/status/rq",
+	"/net/msg/got",
+	"/net/msg/send",
+	"/net/msg/sent",
+	"/net/conn/connected",
+	"/net/conn/are-you-connected",
+	"/net/conn/disconnecting",
+};
+
+
+/** Names registry. */
+struct NamesRegistry {
+	/** Names indexed by ID. */
+	std::vector<std::string> names;
+
+	/** Map from name to ID. */
+	std::map<std::string, unsigned> ids;
+
+	/** Fills registry with predefined names. */
+	NamesRegistry() {
+		const unsigned count = sizeof predefinedNames /
+			sizeof *predefinedNames;
+		assert(count == Signal::CORE_SIG);
+
+		names.reserve(Signal::PREDEFINED);
+		for (unsigned i = 0; i < count; ++i) {
+			add(predefinedNames[i]);
+		}
+		for (unsigned i = Signal::CORE_SIG; i <= Signal::CORE_SIG_LAST; ++i) {
+			char buffer[32];
+			sprintf(buffer, "/core/sig/%u", i - Signal::CORE_SIG);
+			add(buffer);
+		}
+		assert(names.size() == Signal::PREDEFINED);
+	}
+
+	/**
+	 * Returns ID of given name adding it if it's not yet there.
+	 * \param name name to add.
+	 * \return name's ID.
+	 */
+	unsigned add(const std::string &name) {
+		std::pair<std::map<std::string, unsigned>::iterator, bool> ret =
+			ids.insert(std::make_pair(name, (unsigned)names.size()));
+		if (ret.second) {
+			names.push_back(name);
+		}
+		return ret.first->second;
+	}
+};
+
+
+/** Returns names registry creating it on first use. */
+static NamesRegistry &registry() {
+	static NamesRegistry reg;
+	return reg;
+}
+
+
+
+unsigned Signal::intern(const std::string &name) {
+	return registry().add(name);
+}
+
+
+const std::string &Signal::name(unsigned id) {
+	const NamesRegistry &reg = registry();
+	assert(id < reg.names.size());
+	return reg.names[id];
+}
+
+
+}
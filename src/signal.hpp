@@ -23,10 +23,11 @@
 
 #include <string>
 #include <algorithm>
-#include <map>
 
 #include "user.hpp"
+#include "user-table.hpp"
 #include "shared-obj.hpp"
+#include "pool.hpp"
 
 
 namespace ppc {
@@ -57,6 +58,13 @@ struct Module;
  *     message was recieved.</li>
  * </ul>
  *
+ * Signal types as well as module names and reciever patterns are
+ * interned -- each name is given a small integer ID (see intern())
+ * and signals carry only those IDs so copying signals does not copy
+ * any strings and handlers may dispatch with a \c switch on signal's
+ * type.  IDs of all the signal types listed below (and of most
+ * commonly used reciever patterns) are predefined constants.
+ *
  * Signals usually have data associated with them.  Signals keep
  * pointer to abstract structure Signal::Data which should be cast to
  * another structure whitch hold actual data for the signal.  The type
@@ -70,9 +78,8 @@ struct Module;
  *     new module is added; its argument is a sig::StringData
  *     object.</li>
  *   <li>\c /core/sig/num sent by core module each time unix signal
- *     number \c num (other then \c SIGALRM) is recieved (\c num in
- *     signal's name is replaced by signal's number); it has no
- *     argument.</li>
+ *     number \c num is recieved (\c num in signal's name is replaced
+ *     by signal's number); it has no argument.</li>
  *   <li>\c /core/module/removed sent by core module to all modules
  *     when module exits and is removed from list; its argument is
  *     a sig::StringData object.</li>
@@ -153,37 +160,105 @@ struct Signal {
 	typedef shared_obj<const Data> data_ptr;
 
 
+	/** Predefined IDs of names. */
+	enum {
+		NONE = 0,               /**< Empty name. */
+
+		ALL_MODULES,            /**< \c / reciever pattern. */
+		CORE_MODULE,            /**< \c /core module name. */
+		UI_MODULES,             /**< \c /ui/ reciever pattern. */
+		NET_MODULES,            /**< \c /net/ reciever pattern. */
+
+		CORE_TICK,              /**< \c /core/tick signal. */
+		CORE_MODULE_NEW,        /**< \c /core/module/new signal. */
+		CORE_MODULE_REMOVED,    /**< \c /core/module/removed signal. */
+		CORE_MODULE_EXITS,      /**< \c /core/module/exits signal. */
+		CORE_MODULE_QUIT,       /**< \c /core/module/quit signal. */
+		CORE_MODULE_START,      /**< \c /core/module/start signal. */
+		CORE_MODULE_KILL,       /**< \c /core/module/kill signal. */
+
+		UI_MSG_DEBUG,           /**< \c /ui/msg/debug signal. */
+		UI_MSG_INFO,            /**< \c /ui/msg/info signal. */
+		UI_MSG_NOTICE,          /**< \c /ui/msg/notice signal. */
+		UI_MSG_ERROR,           /**< \c /ui/msg/error signal. */
+
+		NET_STATUS_CHANGED,     /**< \c /net/status/changed signal. */
+		NET_STATUS_CHANGE,      /**< \c /net/status/change signal. */
+		NET_STATUS_RQ,          /**< \c /net/status/rq signal. */
+		NET_MSG_GOT,            /**< \c /net/msg/got signal. */
+		NET_MSG_SEND,           /**< \c /net/msg/send signal. */
+		NET_MSG_SENT,           /**< \c /net/msg/sent signal. */
+		NET_CONN_CONNECTED,     /**< \c /net/conn/connected signal. */
+		NET_CONN_ARE_YOU_CONNECTED,
+		                        /**< \c /net/conn/are-you-connected
+		                             signal. */
+		NET_CONN_DISCONNECTING, /**< \c /net/conn/disconnecting signal. */
+
+		CORE_SIG,               /**< \c /core/sig/0 signal, \c
+		                             /core/sig/num signal has ID
+		                             <tt>CORE_SIG + num</tt>. */
+		CORE_SIG_LAST = CORE_SIG + 31,
+		                        /**< \c /core/sig/31 signal. */
+
+		PREDEFINED              /**< Number of predefined IDs. */
+	};
+
+
+	/**
+	 * Returns ID of given name adding it to registry if it is not
+	 * there yet.  IDs are never freed.
+	 * \param name name to intern.
+	 * \return name's ID.
+	 */
+	static unsigned intern(const std::string &name);
+
+	/**
+	 * Returns name with given ID.
+	 * \param id name's ID returned by intern().
+	 * \return name.
+	 */
+	static const std::string &name(unsigned id);
+
+
 	/**
 	 * Constructor sets signal's type and reciever.
-	 * \param t signal's type.
-	 * \param s signal's sender.
-	 * \param r reciever name pattern.
+	 * \param t signal's type ID.
+	 * \param s signal's sender ID.
+	 * \param r reciever name pattern ID.
 	 * \param d signal's data.
 	 */
-	Signal(const std::string &t = "", const std::string &s = "",
-	       const std::string &r = "", const data_ptr &d = data_ptr())
+	Signal(unsigned t = NONE, unsigned s = NONE, unsigned r = NONE,
+	       const data_ptr &d = data_ptr())
 		: data(d), type(t), sender(s), reciever(r) { }
 
 	/**
 	 * Constructor sets signal's type and reciever.
-	 * \param t signal's type.
-	 * \param s signal's sender.
-	 * \param r reciever name pattern.
+	 * \param t signal's type ID.
+	 * \param s signal's sender ID.
+	 * \param r reciever name pattern ID.
 	 * \param d signal to get data from.
 	 */
-	Signal(const std::string &t, const std::string &s,
-	       const std::string &r, const Signal &d)
+	Signal(unsigned t, unsigned s, unsigned r, const Signal &d)
 		: data(d.data), type(t), sender(s), reciever(r) { }
 
 
+	/** Returns signal's type ID. */
+	unsigned getType() const { return type; }
+
+	/** Returns signal's sender ID. */
+	unsigned getSender() const { return sender; }
+
+	/** Returns signal's reciever pattern ID. */
+	unsigned getReciever() const { return reciever; }
+
 	/** Returns signal's type. */
-	const std::string &getType() const { return type; }
+	const std::string &getTypeName() const { return name(type); }
 
 	/** Returns signal's sender. */
-	const std::string &getSender() const { return sender; }
+	const std::string &getSenderName() const { return name(sender); }
 
 	/** Returns signal's reciever pattern. */
-	const std::string &getReciever() const { return reciever; }
+	const std::string &getRecieverName() const { return name(reciever); }
 
 	/** Returns signal's data. */
 	const Data *getData() const { return data.get(); }
@@ -217,10 +292,50 @@ struct Signal {
 	const data_ptr &getDataPointer() const { return data; }
 
 
+	/**
+	 * Sets all signal's fields.  This is used to fill signal in place
+	 * in signals queue without creating a temporary object.
+	 * \param t signal's type ID.
+	 * \param s signal's sender ID.
+	 * \param r reciever name pattern ID.
+	 * \param d signal's data; signal takes ownership of new object.
+	 */
+	void assign(unsigned t, unsigned s, unsigned r, Data *d) {
+		type = t;
+		sender = s;
+		reciever = r;
+		data = d;
+	}
+
+	/**
+	 * Sets all signal's fields.
+	 * \param t signal's type ID.
+	 * \param s signal's sender ID.
+	 * \param r reciever name pattern ID.
+	 * \param d signal's data.
+	 */
+	void assign(unsigned t, unsigned s, unsigned r, const data_ptr &d) {
+		type = t;
+		sender = s;
+		reciever = r;
+		data = d;
+	}
+
+	/**
+	 * Exchanges contents with other signal without touching data's
+	 * reference counter.
+	 * \param sig signal to swap contents with.
+	 */
+	void swap(Signal &sig) {
+		data.swap(sig.data);
+		std::swap(type, sig.type);
+		std::swap(sender, sig.sender);
+		std::swap(reciever, sig.reciever);
+	}
+
 	/** Zeroes all fields. */
 	void clear() {
-		type.clear();
-		reciever = sender = type;
+		type = sender = reciever = NONE;
 		data = (Data*)0;
 	}
 
@@ -229,14 +344,14 @@ private:
 	/** Shared pointer to signal data object. */
 	data_ptr data;
 
-	/** Signal's type. */
-	std::string type;
+	/** Signal's type ID. */
+	unsigned type;
 
-	/** Signal's sender. */
-	std::string sender;
+	/** Signal's sender ID. */
+	unsigned sender;
 
-	/** Signal's reciever pattern. */
-	std::string reciever;
+	/** Signal's reciever pattern ID. */
+	unsigned reciever;
 };
 
 
@@ -258,6 +373,8 @@ struct StringData : public Signal::Data {
 
 	/** Signal's string data. */
 	std::string data;
+
+	PPC_POOL_OPERATORS(StringData)
 };
 
 
@@ -283,6 +400,8 @@ struct UserData : public Signal::Data {
 	/** Flags specifying what have changed/need to be changed. */
 	unsigned flags;
 
+	PPC_POOL_OPERATORS(UserData)
+
 	/** Flags which specify what to change or what was changed. */
 	enum {
 		STATE        =  1,  /**< User's state was changed. */
@@ -338,6 +457,8 @@ struct MessageData : public StringData {
 
 	/** Combination fo \c ACTION and \c MESSAGE flags. */
 	unsigned flags;
+
+	PPC_POOL_OPERATORS(MessageData)
 };
 
 
@@ -352,7 +473,7 @@ struct MessageData : public StringData {
  */
 struct UsersListData : public Signal::Data {
 	/** List of users connected to network. */
-	typedef std::map<User::ID, User *> Users;
+	typedef UserTable Users;
 
 	/** Our user. */
 	User ourUser;
@@ -378,8 +499,7 @@ struct UsersListData : public Signal::Data {
 	/** Deletes all users in users map. */
 	virtual ~UsersListData() {
 		if (!users.empty()) {
-			std::map<User::ID, User *>::iterator it = users.begin();
-			std::map<User::ID, User *>::iterator end = users.end();
+			Users::iterator it = users.begin(), end = users.end();
 			do {
 				delete it->second;
 			} while (++it != end);
@@ -395,4 +515,21 @@ struct UsersListData : public Signal::Data {
 
 }
 
+
+
+namespace std {
+
+/**
+ * Swaps two signals without touching data's reference counter.  This
+ * is used by std::queue when it grows.
+ * \param a first signal.
+ * \param b second signal.
+ */
+template<>
+inline void swap<ppc::Signal>(ppc::Signal &a, ppc::Signal &b) {
+	a.swap(b);
+}
+
+}
+
 #endif
@@ -32,19 +32,9 @@ static void playSound(const std::string &dir, const std::string &file);
 
 unsigned SoundsUI::seq = 0;
 
-int SoundsUI::setFDSets(fd_set *rd, fd_set *wr, fd_set *ex) {
-	(void)rd; (void)wr; (void)ex;
-	return 0;
-}
-
-int SoundsUI::doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-                    const fd_set *ex) {
-	(void)nfds; (void)rd; (void)wr; (void)ex;
-	return 0;
-}
-
 void SoundsUI::recievedSignal(const Signal &sig) {
-	if (sig.getType() == "/net/status/changed") {
+	switch (sig.getType()) {
+	case Signal::NET_STATUS_CHANGED: {
 		const sig::UserData &data = *sig.getData<sig::UserData>();
 		if (!(data.flags & (sig::UserData::CONNECTED | sig::UserData::DISCONNECTED)) &&
 		    data.user.id.address.ip) {
@@ -52,15 +42,18 @@ void SoundsUI::recievedSignal(const Signal &sig) {
 			          getConfig().getString("config/sounds/files/status-changed",
 			                                "status-changed.wav"));
 		}
+		break;
+	}
 
-	} else if (sig.getType() == "/net/msg/got") {
+	case Signal::NET_MSG_GOT:
 		playSound(getConfig().getString("config/sounds/directory", "sounds"),
 		          getConfig().getString("config/sounds/files/got-message",
 		                                "got-message.wav"));
+		break;
 
-	} else if (sig.getType() == "/core/module/quit") {
-		sendSignal("/core/module/exits", Core::coreName);
-
+	case Signal::CORE_MODULE_QUIT:
+		sendSignal(Signal::CORE_MODULE_EXITS, Signal::CORE_MODULE);
+		break;
 	}
 }
 
@@ -29,11 +29,12 @@ struct SoundsUI : public Module {
 	 * Creates sounds user interface object.
 	 * \param c core module.
 	 */
-	SoundsUI(Core &c) : Module(c, "/ui/sounds/", seq++) { }
+	SoundsUI(Core &c) : Module(c, "/ui/sounds/", seq++) {
+		subscribe(Signal::NET_STATUS_CHANGED);
+		subscribe(Signal::NET_MSG_GOT);
+		subscribe(Signal::CORE_MODULE_QUIT);
+	}
 
-	virtual int setFDSets(fd_set *rd, fd_set *wr, fd_set *ex);
-	virtual int doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-	                  const fd_set *ex);
 	virtual void recievedSignal(const Signal &sig);
 
 private:
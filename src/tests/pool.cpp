@@ -0,0 +1,71 @@
+/** \file
+ * Signal data pool tester.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "../signal.hpp"
+
+
+/** Number of objects allocated at once. */
+#define BATCH     64
+
+/** Number of batches. */
+#define ROUNDS 10000
+
+
+template<class T>
+static void report(const char *name) {
+	const unsigned long hits = ppc::Pool<T>::hits();
+	const unsigned long misses = ppc::Pool<T>::misses();
+	printf("%-12s hits %8lu  misses %4lu  hit rate %6.2f%%\n", name,
+	       hits, misses, 100.0 * hits / (hits + misses ? hits + misses : 1));
+}
+
+
+int main(void) {
+	ppc::Signal::data_ptr data[BATCH];
+	const ppc::User::ID id("nick", ppc::Address());
+	int ret = 0;
+
+	for (unsigned round = 0; round < ROUNDS; ++round) {
+		for (unsigned i = 0; i < BATCH; ++i) {
+			switch (i % 3) {
+			case 0: data[i] = new ppc::sig::StringData("foo"); break;
+			case 1: data[i] = new ppc::sig::MessageData(id, "bar"); break;
+			case 2: data[i] = new ppc::sig::UserData(ppc::User(id), 0); break;
+			}
+		}
+		for (unsigned i = 0; i < BATCH; ++i) {
+			data[i] = (ppc::Signal::Data*)0;
+		}
+	}
+
+	report<ppc::sig::StringData>("StringData");
+	report<ppc::sig::MessageData>("MessageData");
+	report<ppc::sig::UserData>("UserData");
+
+	/* Only the first batch should miss. */
+	if (ppc::Pool<ppc::sig::StringData>::misses() > BATCH ||
+	    ppc::Pool<ppc::sig::MessageData>::misses() > BATCH ||
+	    ppc::Pool<ppc::sig::UserData>::misses() > BATCH) {
+		fputs("too many misses\n", stderr);
+		ret = 1;
+	}
+
+	return ret;
+}
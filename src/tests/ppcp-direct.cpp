@@ -0,0 +1,221 @@
+/** \file
+ * Compares and benchmarks ppcp::DirectTokenizer against
+ * ppcp::Tokenizer fed by xml::Tokenizer.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "../ppcp-parser.hpp"
+
+
+/** Number of times packets are parsed in benchmark. */
+#define ROUNDS 200
+
+
+/** Returns random element of an array. */
+#define PICK(array) (array[rand() % (sizeof array / sizeof *array)])
+
+
+/** Returns a random, mostly valid, PPCP packet. */
+static std::string randomPacket() {
+	static const char *const nicks[] = {
+		"mina86", "bob", "alice", "Bob Smith", "x&amp;y", "Zażółć"
+	};
+	static const char *const states[] = {
+		"on", "away", "xa", "dnd", "off", "bogus"
+	};
+	static const char *const texts[] = {
+		"", "hi", "I'm online", "brb &lt;5 min&gt;",
+		"see http://example.com/?a=1&amp;b=2",
+		"Could you send me the logs from yesterday's build?"
+	};
+
+	std::string packet = "<ppcp n=\"";
+	packet += PICK(nicks);
+	packet += rand() % 8 ? "\" p=\"2323\"" : "\" p=\"12\"";
+	if (!(rand() % 4)) {
+		packet += " to:n=\"mina86\"";
+		if (rand() & 1) packet += " to:neg=\"neg\"";
+	}
+	packet += rand() & 1 ? ">\n" : " >";
+
+	for (unsigned n = rand() % 6; n; --n) {
+		switch (rand() % 4) {
+		case 0:
+			packet += "<st st=\"";
+			packet += PICK(states);
+			packet += '"';
+			if (rand() & 1) packet += " dn=\"Display &#x41;\"";
+			if (rand() & 1) {
+				packet += "/>";
+			} else {
+				packet += '>';
+				packet += PICK(texts);
+				if (!(rand() % 4)) packet += "<x y=\"1\">z</x>";
+				packet += "</st>";
+			}
+			break;
+
+		case 1:
+			packet += rand() & 1 ? "<rq/>" : "<rq rq=\"st\" />";
+			break;
+
+		case 2:
+			packet += rand() & 1 ? "<m msg=\"msg\">" : "<m ac=\"ac\">";
+			packet += PICK(texts);
+			packet += "</m>";
+			break;
+
+		default:
+			packet += "<unknown a=\"&amp;\"><st/></unknown>";
+		}
+		packet += rand() & 1 ? "\n" : "";
+	}
+
+	return packet + "</ppcp>";
+}
+
+
+/** Randomly damages a packet. */
+static void mutate(std::string &packet) {
+	static const char chars[] = "<>/=\"& ;#xa";
+	for (unsigned n = 1 + rand() % 3; n && !packet.empty(); --n) {
+		const std::string::size_type i = rand() % packet.length();
+		switch (rand() % 3) {
+		case 0: packet.erase(i, 1); break;
+		case 1: packet.insert(i, 1, PICK(chars)); break;
+		default: packet[i] = PICK(chars);
+		}
+	}
+}
+
+
+/**
+ * Parses data feeding it in random chunks and describes tokens.
+ * \param tokenizer tokenizer to use.
+ * \param data      data to parse.
+ * \param seed      seed used to choose chunks' lengths.
+ * \return description of tokens and error if any.
+ */
+static std::string parse(ppc::ppcp::StandAloneTokenizer &tokenizer,
+                         const std::string &data, unsigned seed) {
+	std::string result;
+	ppc::ppcp::Tokenizer::Token token;
+	char buf[32];
+
+	srand(seed);
+	tokenizer.init(2323);
+	try {
+		std::string::size_type pos = 0;
+		while (pos < data.length()) {
+			std::string::size_type len = 1 + rand() % 16;
+			if (len > data.length() - pos) len = data.length() - pos;
+			tokenizer.feed(data.data() + pos, len);
+			pos += len;
+
+			while (tokenizer.nextToken(token), token) {
+				sprintf(buf, "%d %u ", (int)token.type, token.flags);
+				result += buf + token.data + '|' + token.data2 + '\n';
+				/* Once packet is ignored every call returns IGNORE. */
+				if (token.type == ppc::ppcp::Tokenizer::IGNORE) {
+					break;
+				}
+			}
+		}
+		tokenizer.done();
+	}
+	catch (const ppc::xml::Error &e) {
+		result += "error: " + e.getMessage() + '\n';
+	}
+	return result;
+}
+
+
+/**
+ * Compares both tokenizers on random packets.
+ * \return number of differences.
+ */
+static unsigned compare() {
+	ppc::ppcp::StandAloneTokenizer xml("mina86"), direct("mina86");
+	unsigned errors = 0;
+	direct.setDirect(true);
+
+	for (unsigned round = 0; round < 20000; ++round) {
+		std::string packet = randomPacket();
+		if (round & 1) {
+			mutate(packet);
+		}
+
+		const unsigned seed = rand();
+		const std::string a = parse(xml, packet, seed);
+		const std::string b = parse(direct, packet, seed);
+		srand(seed + round);
+		if (a != b) {
+			printf("packet: %s\nxml:\n%sdirect:\n%s\n",
+			       packet.c_str(), a.c_str(), b.c_str());
+			++errors;
+		}
+	}
+	return errors;
+}
+
+
+/** Measures how long parsing all packets takes. */
+static double benchmark(ppc::ppcp::StandAloneTokenizer &tokenizer,
+                        const std::vector<std::string> &packets) {
+	ppc::ppcp::Tokenizer::Token token;
+	const clock_t start = clock();
+	for (unsigned round = 0; round < ROUNDS; ++round) {
+		for (unsigned i = 0; i < packets.size(); ++i) {
+			tokenizer.init(2323);
+			tokenizer.feed(packets[i]);
+			while (tokenizer.nextToken(token),
+			       token && token.type != ppc::ppcp::Tokenizer::IGNORE);
+		}
+	}
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int main(void) {
+	srand(time(0));
+
+	const unsigned errors = compare();
+	printf("%u differences\n", errors);
+
+	std::vector<std::string> packets;
+	unsigned long bytes = 0;
+	for (unsigned i = 0; i < 1000; ++i) {
+		packets.push_back(randomPacket());
+		bytes += packets.back().length();
+	}
+
+	ppc::ppcp::StandAloneTokenizer xml("mina86"), direct("mina86");
+	direct.setDirect(true);
+	const double mb = (double)bytes * ROUNDS / (1024 * 1024);
+	const double xmlTime = benchmark(xml, packets);
+	const double directTime = benchmark(direct, packets);
+	printf("two-layer %8.1f MiB/s\ndirect    %8.1f MiB/s\n",
+	       mb / xmlTime, mb / directTime);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+/** \file
+ * A timer wheel implementation tester.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "../timer.hpp"
+
+
+/** Number of one-shot timers. */
+#define COUNT   500
+
+/** Maximal delay of one-shot timers in milliseconds. */
+#define MAX_DELAY 3000
+
+/**
+ * Maximal delay of one-shot timers in milliseconds when fake clock
+ * is used.  It is twice as long as the whole wheel covers so every
+ * level cascades and some timers are rescheduled from the last slot.
+ */
+#define FAKE_MAX_DELAY \
+	(2UL * PPC_TIMER_JIFFY << (PPC_TIMER_BITS * PPC_TIMER_LEVELS))
+
+/** Period of the periodic timer in milliseconds. */
+#define PERIOD   250
+
+/** How late timer may expire in milliseconds. */
+#define SLACK (3 * PPC_TIMER_JIFFY)
+
+
+/**
+ * Current value of fake monotonic clock in milliseconds or zero if
+ * real clock is used.
+ */
+static unsigned long fakeClock = 0;
+
+
+/**
+ * Overrides C library's function so that TimerWheel::now() returns
+ * fakeClock if it is set.
+ */
+extern "C" int clock_gettime(clockid_t clk, struct timespec *ts) throw() {
+	if (!fakeClock) {
+		return syscall(SYS_clock_gettime, clk, ts);
+	}
+	ts->tv_sec = fakeClock / 1000;
+	ts->tv_nsec = (fakeClock % 1000) * 1000000;
+	return 0;
+}
+
+
+
+struct Tester : public ppc::TimerHandler {
+	ppc::TimerWheel wheel;
+	ppc::Timer timers[COUNT], periodic;
+	unsigned long due[COUNT], start;
+	unsigned expired, ticks;
+	int ret;
+
+	Tester() : expired(0), ticks(0), ret(0) {
+		start = ppc::TimerWheel::now();
+		for (unsigned i = 0; i < COUNT; ++i) {
+			unsigned long delay = rand();
+			if (!fakeClock) {
+				delay %= MAX_DELAY;
+			} else {
+				/* Spread delays over all levels. */
+				const unsigned shift =
+					PPC_TIMER_BITS * (i % (PPC_TIMER_LEVELS + 1));
+				delay %= FAKE_MAX_DELAY >> shift;
+			}
+			due[i] = start + delay;
+			wheel.start(timers[i], *this, delay);
+		}
+		wheel.start(periodic, *this, PERIOD, PERIOD);
+	}
+
+	virtual void handleTimer(ppc::Timer &timer) {
+		const unsigned long now = ppc::TimerWheel::now();
+
+		if (&timer == &periodic) {
+			++ticks;
+			return;
+		}
+
+		const unsigned i = &timer - timers;
+		if (now < due[i] || now > due[i] + SLACK) {
+			fprintf(stderr, "timer %3u: expired at %5lu, expected %5lu\n",
+			        i, now - start, due[i] - start);
+			ret = 1;
+		}
+
+		/* Every tenth timer stops the next one. */
+		if (i % 10 == 0 && i + 1 < COUNT && timers[i + 1].isRunning()) {
+			timers[i + 1].stop();
+			++expired;
+		}
+		++expired;
+	}
+};
+
+
+/** Runs the test using either real or fake clock. */
+static int test() {
+	Tester tester;
+	while (tester.expired < COUNT) {
+		if (!fakeClock) {
+			poll(0, 0, tester.wheel.getTimeout());
+		} else if (fakeClock - tester.start <= FAKE_MAX_DELAY + SLACK) {
+			fakeClock += tester.wheel.getTimeout();
+		} else {
+			fprintf(stderr, "%u timer(s) never expired\n",
+			        COUNT - tester.expired);
+			return 1;
+		}
+		tester.wheel.run();
+	}
+
+	const unsigned long elapsed = ppc::TimerWheel::now() - tester.start;
+	printf("expired: %u, periodic: %u (expected ~%lu)\n",
+	       tester.expired, tester.ticks, elapsed / PERIOD);
+	if (tester.ticks + 1 < elapsed / PERIOD) {
+		fputs("periodic timer expired too rarely\n", stderr);
+		tester.ret = 1;
+	}
+
+	tester.periodic.stop();
+	if (tester.wheel.getTimeout() != -1) {
+		fputs("wheel not empty\n", stderr);
+		tester.ret = 1;
+	}
+
+	return tester.ret;
+}
+
+
+int main(void) {
+	{
+		unsigned int seed = time(0);
+		srand(seed);
+		printf("seed: %u\n", seed);
+	}
+
+	int ret = test();
+
+	/* Long delays make higher levels cascade; there's no point in
+	   waiting for them for real. */
+	fakeClock = 1000000;
+	ret |= test();
+	return ret;
+}
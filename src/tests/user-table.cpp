@@ -0,0 +1,166 @@
+/** \file
+ * User hash table tester.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <map>
+#include <vector>
+
+#include "../user-table.hpp"
+
+
+/** Number of distinct identifiers. */
+#define IDS      2048
+
+/** Number of random operations. */
+#define ROUNDS 200000
+
+/** Number of lookups in benchmark. */
+#define LOOKUPS 5000000
+
+
+/** Returns current time in seconds. */
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/** Compares table with reference map. */
+static unsigned check(const ppc::UserTable &table,
+                      const std::map<ppc::User::ID, ppc::User *> &map) {
+	unsigned errors = 0;
+	if (table.size() != map.size()) {
+		printf("size mismatch: %lu vs %lu\n", (unsigned long)table.size(),
+		       (unsigned long)map.size());
+		++errors;
+	}
+
+	unsigned n = 0;
+	ppc::UserTable::const_iterator it = table.begin(), end = table.end();
+	for (; it != end; ++it, ++n) {
+		std::map<ppc::User::ID, ppc::User *>::const_iterator m;
+		m = map.find(it->first);
+		if (m == map.end() || m->second != it->second) {
+			printf("%s: bad entry\n", it->first.toString().c_str());
+			++errors;
+		}
+	}
+	if (n != map.size()) {
+		printf("iterated over %u entries, expected %lu\n", n,
+		       (unsigned long)map.size());
+		++errors;
+	}
+	return errors;
+}
+
+
+int main(void) {
+	std::vector<ppc::User::ID> ids;
+	char buf[16];
+	for (unsigned i = 0; i < IDS; ++i) {
+		sprintf(buf, "nick%u", i % 97);
+		ids.push_back(ppc::User::ID(buf, ppc::Address(0x0a000000 + i % 13,
+		                                              2000 + i / 13)));
+	}
+
+	ppc::UserTable table;
+	std::map<ppc::User::ID, ppc::User *> map;
+	unsigned errors = 0;
+
+	srand(0);
+	for (unsigned round = 0; round < ROUNDS; ++round) {
+		const ppc::User::ID &id = ids[rand() % IDS];
+		ppc::User *const value = (ppc::User *)(size_t)(round + 1);
+
+		switch (rand() % 3) {
+		case 0: {
+			const bool inserted = table.insert(std::make_pair(id, value)).second;
+			if (inserted != map.insert(std::make_pair(id, value)).second) {
+				printf("%s: insert mismatch\n", id.toString().c_str());
+				++errors;
+			}
+			break;
+		}
+
+		case 1: {
+			ppc::UserTable::iterator it = table.find(id);
+			if ((it == table.end()) != (map.find(id) == map.end())) {
+				printf("%s: find mismatch\n", id.toString().c_str());
+				++errors;
+			} else if (it != table.end()) {
+				table.erase(it);
+				map.erase(id);
+			}
+			break;
+		}
+
+		case 2:
+			if ((table.find(id) == table.end()) !=
+			    (map.find(id) == map.end())) {
+				printf("%s: find mismatch\n", id.toString().c_str());
+				++errors;
+			}
+			break;
+		}
+
+		if (round % 1000 == 0) {
+			errors += check(table, map);
+		}
+	}
+	errors += check(table, map);
+
+	/* Erase while iterating, the way Network::performTick() does. */
+	ppc::UserTable::iterator it = table.begin();
+	while (it != table.end()) {
+		if (rand() % 2) {
+			map.erase(it->first);
+			it = table.erase(it);
+		} else {
+			++it;
+		}
+	}
+	errors += check(table, map);
+
+	/* Benchmark */
+	for (unsigned i = 0; i < IDS; ++i) {
+		table.insert(std::make_pair(ids[i], (ppc::User *)0));
+		map.insert(std::make_pair(ids[i], (ppc::User *)0));
+	}
+
+	unsigned long found = 0;
+	double start = now();
+	for (unsigned i = 0; i < LOOKUPS; ++i) {
+		found += table.find(ids[i % IDS]) != table.end();
+	}
+	const double tableTime = now() - start;
+
+	start = now();
+	for (unsigned i = 0; i < LOOKUPS; ++i) {
+		found += map.find(ids[i % IDS]) != map.end();
+	}
+	const double mapTime = now() - start;
+
+	printf("lookups: table %.3fs, map %.3fs (%lu found)\n",
+	       tableTime, mapTime, found);
+	printf("%u error(s)\n", errors);
+	return errors ? 1 : 0;
+}
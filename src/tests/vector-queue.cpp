@@ -105,6 +105,11 @@ static void push(struct nonint_data &data) {
 		        data.outer, data.inner, data.pushed, val);
 		data.ret = 1;
 	}
+	if ((val = data.queue[data.count - 1]) != data.pushed) {
+		fprintf(stderr, "%lu.%9lu: pushed %10lu but [%u] is %10lu\n",
+		        data.outer, data.inner, data.pushed, data.count - 1, val);
+		data.ret = 1;
+	}
 	check_size(data);
 }
 
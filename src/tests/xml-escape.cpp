@@ -0,0 +1,174 @@
+/** \file
+ * Checks and benchmarks xml::escape() and xml::unescapeInPlace().
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "../xml-parser.hpp"
+
+
+/** Number of times each payload set is processed in benchmark. */
+#define ROUNDS 20000
+
+
+/** Escapes string the simplest possible way. */
+static std::string reference(const std::string &str) {
+	std::string result;
+	for (std::string::size_type i = 0; i < str.length(); ++i) {
+		char buf[8];
+		if (memchr("<>&\"'", str[i], 6)) {
+			sprintf(buf, "&#%d;", (int)str[i]);
+			result += buf;
+		} else {
+			result += str[i];
+		}
+	}
+	return result;
+}
+
+
+/** Returns random string with roughly every \a ratio-th char special. */
+static std::string randomString(unsigned length, unsigned ratio) {
+	static const char special[] = "<>&\"'";
+	std::string str;
+	for (unsigned i = 0; i < length; ++i) {
+		if (ratio && !(rand() % ratio)) {
+			str += special[rand() % sizeof special];
+		} else {
+			str += (char)(' ' + rand() % 95);
+			if (memchr("<>&\"'", str[i], 5)) {
+				str[i] = '.';
+			}
+		}
+	}
+	return str;
+}
+
+
+/** Checks escape() and unescape() on random input. */
+static unsigned check() {
+	unsigned errors = 0;
+	for (unsigned round = 0; round < 20000; ++round) {
+		const std::string str = randomString(rand() % 200, 1 + rand() % 16);
+		const std::string escaped = ppc::xml::escape(str);
+		if (escaped != reference(str)) {
+			printf("escape mismatch: '%s'\n", str.c_str());
+			++errors;
+		} else if (ppc::xml::unescape(escaped) != str) {
+			printf("unescape mismatch: '%s'\n", escaped.c_str());
+			++errors;
+		}
+	}
+
+	static const char *const entities[] = {
+		"&#65;", "&#x41;", "&#X41;", "&#;", "&#x;", "&#4294967296;",
+		"&#x100000000;", "&#-1;", "&#+65;", "&lt", "&quot;", 0
+	};
+	static const char *const expected[] = {
+		"A", "A", 0, 0, 0, 0, 0, 0, 0, 0, 0
+	};
+	for (unsigned i = 0; entities[i]; ++i) {
+		const char *result;
+		std::string str;
+		try {
+			str = ppc::xml::unescape(entities[i]);
+			result = str.c_str();
+		}
+		catch (const ppc::xml::Error &) {
+			result = 0;
+		}
+		if (expected[i] ? !result || strcmp(result, expected[i]) : !!result) {
+			printf("%s: got %s\n", entities[i], result ? result : "error");
+			++errors;
+		}
+	}
+
+	return errors;
+}
+
+
+/** Prints throughput of escape() and unescape() on given payloads. */
+static void benchmark(const char *name,
+                      const std::vector<std::string> &payloads) {
+	std::vector<std::string> escaped;
+	unsigned long bytes = 0;
+	for (unsigned i = 0; i < payloads.size(); ++i) {
+		escaped.push_back(ppc::xml::escape(payloads[i]));
+		bytes += payloads[i].length();
+	}
+
+	clock_t start = clock();
+	unsigned long sink = 0;
+	for (unsigned round = 0; round < ROUNDS; ++round) {
+		for (unsigned i = 0; i < payloads.size(); ++i) {
+			sink += ppc::xml::escape(payloads[i]).length();
+		}
+	}
+	const double escapeTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	for (unsigned round = 0; round < ROUNDS; ++round) {
+		for (unsigned i = 0; i < escaped.size(); ++i) {
+			std::string str(escaped[i]);
+			sink += ppc::xml::unescapeInPlace(str).length();
+		}
+	}
+	const double unescapeTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	const double mb = (double)bytes * ROUNDS / (1024 * 1024);
+	printf("%-8s escape %8.1f MiB/s   unescape %8.1f MiB/s   (%lu)\n",
+	       name, mb / escapeTime, mb / unescapeTime, sink & 1);
+}
+
+
+int main(void) {
+	srand(time(0));
+
+	const unsigned errors = check();
+	printf("%u errors\n", errors);
+
+	static const char *const chat[] = {
+		"hi", "hello there, how are you doing today?",
+		"brb", "ok :)", "see http://example.com/?a=1&b=2",
+		"did you read \"The <Art> of Computer Programming\"?",
+		"I'm fine, thanks", "lol", "meeting at 5pm in room 101",
+		"Available", "Away - back in 10 minutes",
+		"Could you send me the logs from yesterday's build?"
+	};
+	std::vector<std::string> payloads(chat, chat + sizeof chat / sizeof *chat);
+	benchmark("chat", payloads);
+
+	payloads.clear();
+	for (unsigned i = 0; i < 16; ++i) {
+		payloads.push_back(randomString(1024, 0));
+	}
+	benchmark("clean", payloads);
+
+	payloads.clear();
+	for (unsigned i = 0; i < 16; ++i) {
+		payloads.push_back(randomString(1024, 8));
+	}
+	benchmark("dirty", payloads);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+/** \file
+ * Checks vectorised XML scanners against portable one.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../xml-scan.hpp"
+
+
+/** Characters random input is built from. */
+static const char alphabet[] = " \t\n\r\f\vaZ09:-_.\"<>&\x80\xff'\0";
+
+
+/**
+ * Compares \a scanner's functions with portable implementation.
+ * \param scanner scanner to check.
+ * \return number of mismatches found.
+ */
+static unsigned check(const ppc::xml::Scanner &scanner) {
+	const ppc::xml::Scanner &ref = ppc::xml::Scanner::scalar;
+	char buffer[256];
+	unsigned errors = 0;
+
+	for (unsigned round = 0; round < 100000; ++round) {
+		/* Long runs of a single class make vector loops matter. */
+		const unsigned len = rand() % sizeof buffer;
+		const char fill = alphabet[rand() % (sizeof alphabet - 1)];
+		for (unsigned i = 0; i < len; ++i) {
+			buffer[i] = rand() % 8 ? fill
+				: alphabet[rand() % (sizeof alphabet - 1)];
+		}
+
+		const unsigned start = len ? rand() % len : 0;
+		const char *const it = buffer + start, *const end = buffer + len;
+
+#define CHECK(fn) do { \
+			if (scanner.fn(it, end) != ref.fn(it, end)) { \
+				printf("%s: %s: mismatch at %u..%u\n", \
+				       scanner.name, #fn, start, len); \
+				++errors; \
+			} \
+		} while (0)
+
+		CHECK(findTagDelimiter);
+		CHECK(findValueDelimiter);
+		CHECK(skipSpaces);
+		CHECK(skipNameChars);
+		CHECK(findSpecial);
+
+#undef CHECK
+	}
+
+	return errors;
+}
+
+
+int main(void) {
+	unsigned errors = 0;
+
+	srand(time(0));
+	printf("best: %s\n", ppc::xml::Scanner::best().name);
+	errors += check(ppc::xml::Scanner::best());
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+	errors += check(ppc::xml::Scanner::sse2);
+	if (__builtin_cpu_supports("avx2")) {
+		errors += check(ppc::xml::Scanner::avx2);
+	}
+#endif
+
+	printf("%u errors\n", errors);
+	return errors ? 1 : 0;
+}
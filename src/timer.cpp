@@ -0,0 +1,202 @@
+/** \file
+ * Timers implementation.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <time.h>
+
+#include "timer.hpp"
+
+
+/** Mask of slot index. */
+#define MASK ((1UL << PPC_TIMER_BITS) - 1)
+
+
+namespace ppc {
+
+
+TimerWheel::TimerWheel() : jiffies(0), base(now()), count(0) {
+	for (unsigned level = 0; level < PPC_TIMER_LEVELS; ++level) {
+		for (unsigned i = 0; i < SLOTS; ++i) {
+			slots[level][i] = 0;
+		}
+	}
+}
+
+
+unsigned long TimerWheel::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+
+
+void TimerWheel::start(Timer &timer, TimerHandler &handler,
+                       unsigned long delay, unsigned long period) {
+	if (!timer.wheel) {
+		++count;
+	} else {
+		assert(timer.wheel == this);
+		unlink(timer);
+	}
+
+	timer.wheel = this;
+	timer.handler = &handler;
+	timer.expires = currentJiffy() +
+		(delay + PPC_TIMER_JIFFY - 1) / PPC_TIMER_JIFFY;
+	timer.period = period
+		? (period + PPC_TIMER_JIFFY - 1) / PPC_TIMER_JIFFY : 0;
+	link(timer);
+}
+
+
+void TimerWheel::link(Timer &timer) {
+	unsigned long idx = timer.expires - jiffies;
+	Timer **slot;
+
+	if ((long)idx < 0) {
+		/* Already expired, will be run with the next jiffy. */
+		slot = &slots[0][jiffies & MASK];
+	} else {
+		unsigned level = 0;
+		while (level < PPC_TIMER_LEVELS - 1 &&
+		       idx >= 1UL << (PPC_TIMER_BITS * (level + 1))) {
+			++level;
+		}
+
+		/* Too far in the future, put it in the last slot; it will be
+		   rescheduled when cascaded. */
+		if (idx >= 1UL << (PPC_TIMER_BITS * PPC_TIMER_LEVELS)) {
+			idx = (1UL << (PPC_TIMER_BITS * PPC_TIMER_LEVELS)) - 1;
+		}
+
+		const unsigned long expires = jiffies + idx;
+		const unsigned shift = PPC_TIMER_BITS * level;
+		slot = &slots[level][(expires >> shift) & MASK];
+	}
+
+	timer.next = *slot;
+	if (timer.next) {
+		timer.next->pprev = &timer.next;
+	}
+	timer.pprev = slot;
+	*slot = &timer;
+}
+
+
+unsigned TimerWheel::cascade(unsigned level, unsigned index) {
+	Timer *timer = slots[level][index];
+	slots[level][index] = 0;
+	while (timer) {
+		Timer *const next = timer->next;
+		link(*timer);
+		timer = next;
+	}
+	return index;
+}
+
+
+
+unsigned TimerWheel::run() {
+	const unsigned long target = currentJiffy();
+	unsigned expired = 0;
+
+	while ((long)(target - jiffies) >= 0) {
+		const unsigned index = jiffies & MASK;
+
+		/* Cascade higher levels when lower level wraps around. */
+		if (!index) {
+			unsigned level = 1, shift = PPC_TIMER_BITS;
+			while (level < PPC_TIMER_LEVELS &&
+			       !cascade(level, (jiffies >> shift) & MASK)) {
+				++level;
+				shift += PPC_TIMER_BITS;
+			}
+		}
+
+		/* Move expired timers to a local list so that handlers may
+		   safely start and stop timers. */
+		Timer *pending = slots[0][index];
+		slots[0][index] = 0;
+		if (pending) {
+			pending->pprev = &pending;
+		}
+		++jiffies;
+
+		while (pending) {
+			Timer &timer = *pending;
+			unlink(timer);
+
+			if (!timer.period) {
+				timer.wheel = 0;
+				--count;
+			} else {
+				/* If we are late do not try to catch up. */
+				timer.expires += timer.period;
+				if ((long)(timer.expires - target) <= 0) {
+					timer.expires = target + timer.period;
+				}
+				link(timer);
+			}
+
+			++expired;
+			timer.handler->handleTimer(timer);
+		}
+	}
+
+	return expired;
+}
+
+
+
+int TimerWheel::getTimeout() const {
+	if (!count) {
+		return -1;
+	}
+
+	/* Look for first non-empty slot at level zero. */
+	unsigned long next = jiffies + SLOTS;
+	for (unsigned i = 0; i < SLOTS; ++i) {
+		if (slots[0][(jiffies + i) & MASK]) {
+			next = jiffies + i;
+			break;
+		}
+	}
+
+	/* At higher levels look for first non-empty slot that will be
+	   cascaded.  Timers in it won't expire before it is cascaded. */
+	for (unsigned level = 1; level < PPC_TIMER_LEVELS; ++level) {
+		const unsigned shift = PPC_TIMER_BITS * level;
+		unsigned long jiffy = ((jiffies + (1UL << shift) - 1) >> shift)
+			<< shift;
+		for (unsigned i = 0; i < SLOTS && (long)(next - jiffy) > 0;
+		     ++i, jiffy += 1UL << shift) {
+			if (slots[level][(jiffy >> shift) & MASK]) {
+				next = jiffy;
+				break;
+			}
+		}
+	}
+
+	const long ms = (long)(next * PPC_TIMER_JIFFY - (now() - base));
+	return ms <= 0 ? 0 : ms >= INT_MAX ? INT_MAX : (int)ms;
+}
+
+
+}
@@ -0,0 +1,245 @@
+/** \file
+ * Timers.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_TIMER_HPP
+#define H_TIMER_HPP
+
+
+/** Timer wheel resolution in milliseconds. */
+#define PPC_TIMER_JIFFY          10
+
+/** Number of bits of slot index in each level of timer wheel. */
+#define PPC_TIMER_BITS            6
+
+/** Number of levels of timer wheel. */
+#define PPC_TIMER_LEVELS          4
+
+
+namespace ppc {
+
+
+struct Timer;
+struct TimerWheel;
+
+
+/**
+ * An object which wants to be notified when Timer it started
+ * expires.
+ */
+struct TimerHandler {
+	/** Destructor. */
+	virtual ~TimerHandler() { }
+
+	/**
+	 * Called by TimerWheel when timer expires.  When this method is
+	 * called a one-shot timer is already stopped and a periodic timer
+	 * is already rearmed so handler may freely restart, stop or even
+	 * delete the timer.
+	 *
+	 * \param timer timer which expired.
+	 */
+	virtual void handleTimer(Timer &timer) = 0;
+};
+
+
+
+/**
+ * A timer which can be started in a TimerWheel.  Timer is an
+ * intrusive list node so starting and stopping it never allocates
+ * memory.  Object using a timer usually keeps it as a member; when
+ * timer is destroyed it is stopped automatically.
+ */
+struct Timer {
+	/** Default constructor. */
+	Timer() : wheel(0), handler(0), next(0), pprev(0), expires(0),
+	          period(0) { }
+
+	/** Stops timer if it is running. */
+	~Timer() {
+		stop();
+	}
+
+	/** Returns \c true iff timer is running. */
+	bool isRunning() const { return wheel; }
+
+	/** Stops timer if it is running. */
+	inline void stop();
+
+
+private:
+	/** Wheel timer is running in or \c NULL. */
+	TimerWheel *wheel;
+
+	/** Object to notify when timer expires. */
+	TimerHandler *handler;
+
+	/** Next timer in slot. */
+	Timer *next;
+
+	/** Pointer to pointer pointing to this timer. */
+	Timer **pprev;
+
+	/** Jiffy timer expires at. */
+	unsigned long expires;
+
+	/** Timer's period in jiffies or zero if it's a one-shot timer. */
+	unsigned long period;
+
+
+	/** Copying not allowed.
+	 * \param t ignored. */
+	Timer(const Timer &t) { (void)t; }
+	/** Copying not allowed.
+	 * \param t ignored. */
+	void operator=(const Timer &t) { (void)t; }
+
+	friend struct TimerWheel;
+};
+
+
+
+/**
+ * A hierarchical timer wheel.  Timers are kept in \c
+ * PPC_TIMER_LEVELS levels of slots each level covering range \c
+ * 2^PPC_TIMER_BITS times wider then the previous one.  Starting and
+ * stopping a timer is O(1) and timers from a higher level are moved
+ * ("cascaded") to lower levels only when they come close to expire so
+ * running the wheel costs time proportional to number of expired
+ * timers.  Timers further in the future then the wheel covers are
+ * placed in the last slot and rescheduled when it is cascaded.
+ *
+ * Wheel's clock has resolution of \c PPC_TIMER_JIFFY milliseconds
+ * and is based on a monotonic clock so it is not affected by
+ * changes of system time.
+ */
+struct TimerWheel {
+	/** Initialises empty wheel. */
+	TimerWheel();
+
+
+	/**
+	 * Starts timer.  If timer is already running it is restarted.
+	 *
+	 * \param timer   timer to start.
+	 * \param handler object to notify when timer expires.
+	 * \param delay   number of milliseconds after which timer
+	 *                expires.
+	 * \param period  if non-zero timer is periodic and after
+	 *                expiring it is restarted with given delay.
+	 */
+	void start(Timer &timer, TimerHandler &handler, unsigned long delay,
+	           unsigned long period = 0);
+
+	/**
+	 * Stops timer.  Timer must be running in this wheel.
+	 * \param timer timer to stop.
+	 */
+	void stop(Timer &timer) {
+		unlink(timer);
+		timer.wheel = 0;
+		--count;
+	}
+
+
+	/**
+	 * Returns number of milliseconds till the next timer may expire
+	 * (it is guaranteed that no timer will expire sooner) or -1 if
+	 * there are no running timers.  Returned value is suitable for
+	 * Poller::poll() timeout argument.
+	 */
+	int getTimeout() const;
+
+	/**
+	 * Calls handlers of all timers which expired.
+	 * \return number of expired timers.
+	 */
+	unsigned run();
+
+
+	/** Returns number of milliseconds of monotonic clock. */
+	static unsigned long now();
+
+
+private:
+	/** Number of slots in each level. */
+	enum { SLOTS = 1 << PPC_TIMER_BITS };
+
+	/** Slots. */
+	Timer *slots[PPC_TIMER_LEVELS][SLOTS];
+
+	/** Jiffy which will be processed next. */
+	unsigned long jiffies;
+
+	/** Value of now() at the moment wheel was created. */
+	unsigned long base;
+
+	/** Number of running timers. */
+	unsigned long count;
+
+
+	/** Returns current jiffy of wheel's clock. */
+	unsigned long currentJiffy() const {
+		return (now() - base) / PPC_TIMER_JIFFY;
+	}
+
+	/**
+	 * Puts timer in a slot apropriate for its expire time.
+	 * \param timer timer to put.
+	 */
+	void link(Timer &timer);
+
+	/**
+	 * Removes timer from slot it is in.
+	 * \param timer timer to remove.
+	 */
+	static void unlink(Timer &timer) {
+		*timer.pprev = timer.next;
+		if (timer.next) {
+			timer.next->pprev = timer.pprev;
+		}
+	}
+
+	/**
+	 * Moves all timers from given slot to lower levels.
+	 * \param level level of slot, greater then zero.
+	 * \param index slot's index.
+	 * \return \a index.
+	 */
+	unsigned cascade(unsigned level, unsigned index);
+
+
+	/** Copying not allowed.
+	 * \param w ignored. */
+	TimerWheel(const TimerWheel &w) { (void)w; }
+	/** Copying not allowed.
+	 * \param w ignored. */
+	void operator=(const TimerWheel &w) { (void)w; }
+};
+
+
+
+void Timer::stop() {
+	if (wheel) {
+		wheel->stop(*this);
+	}
+}
+
+
+}
+
+#endif
@@ -49,6 +49,18 @@ UI::UI(Core &c, int infd /* some more arguments */)
 	chatUser(std::string(), Address()) {
 
 	FileDescriptor::setNonBlocking(infd);
+	watchFD(infd, Poller::READ);
+
+	subscribe(Signal::NET_STATUS_CHANGED);
+	subscribe(Signal::NET_MSG_GOT);
+	subscribe(Signal::NET_MSG_SENT);
+	subscribe(Signal::NET_CONN_CONNECTED);
+	subscribe(Signal::CORE_MODULE_REMOVED);
+	subscribe(Signal::UI_MSG_DEBUG);
+	subscribe(Signal::UI_MSG_INFO);
+	subscribe(Signal::UI_MSG_NOTICE);
+	subscribe(Signal::UI_MSG_ERROR);
+	subscribe(Signal::CORE_MODULE_QUIT);
 
 	/* enable windowed mode */
 	initscr();
@@ -74,7 +86,7 @@ UI::UI(Core &c, int infd /* some more arguments */)
 	/* ask network modules if they are connected, we'll get whole
 	   a lot of /net/conn/connected signals if they are connected
 	   signals */
-	sendSignal("/net/conn/are-you-connected", "/net/");
+	sendSignal(Signal::NET_CONN_ARE_YOU_CONNECTED, Signal::NET_MODULES);
 	messageW->printf("Hello from User Interface on fd=%d\n", infd);
 	wnoutrefresh(stdscr);
 	messageW->refresh();
@@ -84,6 +96,8 @@ UI::UI(Core &c, int infd /* some more arguments */)
 
 
 UI::~UI() {
+	unwatchFD(stdin_fd);
+
 	/* destroy windows */
 	delete messageW;
 	delete statusW;
@@ -94,20 +108,8 @@ UI::~UI() {
 }
 
 
-int UI::setFDSets(fd_set *rd, fd_set *wr, fd_set *ex) {
-	(void)wr; (void)ex;
-	FD_SET(stdin_fd, rd);
-	return stdin_fd+1;
-}
-
-
-int UI::doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-                  const fd_set *ex) {
-	(void)nfds; (void)wr; (void)ex;
-
-	if (!FD_ISSET(stdin_fd, rd)) {
-		return 0;
-	}
+void UI::handleFD(int fd, unsigned events) {
+	(void)fd; (void)events;
 
 	/* read the data from stdin_fd and put it inside data.  If user
 	   typed enter you do the rest of the method otherwise you return
@@ -119,7 +121,7 @@ int UI::doFDs(int nfds, const fd_set *rd, const fd_set *wr,
 
 	int c;
 	if((c = getch()) == ERR) {
-		return -1;
+		return;
 	}
 
 	if(completionModeActive) {
@@ -127,34 +129,33 @@ int UI::doFDs(int nfds, const fd_set *rd, const fd_set *wr,
 	} else {
 		handleCharacter(c);
 	}
-	return 1;
 }
 
 
 void UI::recievedSignal(const Signal &sig) {
-	if (sig.getType() == "/core/tick") {
-		/* one second have passed, maybe you need to do something? */
-
-
-	} else if (sig.getType() == "/net/status/changed") {
+	switch (sig.getType()) {
+	case Signal::NET_STATUS_CHANGED:
 		/* a user have changed status or display name or have just
 		   connected ot it have just disconnected, it's all in data.
 		   You may (shoul) identify network which sent information by
-		   sig.getSender(). */
-		handleSigStatusChanged(sig.getSender(),
+		   sig.getSenderName(). */
+		handleSigStatusChanged(sig.getSenderName(),
 		                       *sig.getData<sig::UserData>());
 		messageW->refresh(true);
+		break;
 
 
-	} else if (sig.getType() == "/net/msg/got") {
+	case Signal::NET_MSG_GOT: {
 		const sig::MessageData &data = *sig.getData<sig::MessageData>();
 		messageW->printf(data.flags & sig::MessageData::ACTION
 		                 ? " * %s %s\n" : " <%s> %s\n",
-		                 userName(sig.getSender(), data.id).c_str(),
+		                 userName(sig.getSenderName(), data.id).c_str(),
 		                 data.data.c_str());
 		messageW->refresh(true);
+		break;
+	}
 
-	} else if (sig.getType() == "/net/msg/sent") {
+	case Signal::NET_MSG_SENT: {
 		const sig::MessageData &data = *sig.getData<sig::MessageData>();
 		if (data.flags & sig::MessageData::RAW) {
 			/* nothing */
@@ -162,13 +163,15 @@ void UI::recievedSignal(const Signal &sig) {
 			messageW->printf("> %s\n", data.data.c_str());
 		} else {
 			messageW->printf(" * %s %s\n",
-			                 ourUserName(sig.getSender()).c_str(),
+			                 ourUserName(sig.getSenderName()).c_str(),
 			                 data.data.c_str());
 		}
 		messageW->refresh(true);
+		break;
+	}
 
 
-	} else if (sig.getType() == "/net/conn/connected") {
+	case Signal::NET_CONN_CONNECTED: {
 		/* wow! a new network :) and it sents us its user list.
 		   Signal's argument is a sig::UsersListData which you may
 		   refer to while the network is connected.  Yes! you don't
@@ -184,27 +187,34 @@ void UI::recievedSignal(const Signal &sig) {
 
 		/* sorry -- couldn't think of better way, the const_cast
 		   is required */
-		networkUsers[sig.getSender()] = const_cast<sig::UsersListData*>(data);
+		networkUsers[sig.getSenderName()] =
+			const_cast<sig::UsersListData*>(data);
+		break;
+	}
 
-	} else if (sig.getType() == "/core/module/removed") {
+	case Signal::CORE_MODULE_REMOVED:
 		/* module have been removed; it might be a network */
-		std::string module_name = sig.getData<sig::StringData>()->data;
-		networkUsers.erase(networkUsers.find(module_name));
+		networkUsers.erase(sig.getData<sig::StringData>()->data);
+		break;
 
-	} else if (!strncmp(sig.getType().c_str(), "/ui/msg/", 8)) {
+	case Signal::UI_MSG_DEBUG:
+	case Signal::UI_MSG_INFO:
+	case Signal::UI_MSG_NOTICE:
+	case Signal::UI_MSG_ERROR:
 		/* this is some kind of message.  Type is one of:
 		   /ui/msg/debug, /ui/msg/info, /ui/msg/notice or
 		   /ui/msg/error.  You may choose to display that message
 		   (especially if it's an error */
-		messageW->printf("[%s] %s\n", sig.getType().c_str() + 8,
+		messageW->printf("[%s] %s\n", sig.getTypeName().c_str() + 8,
 		        sig.getData<sig::StringData>()->data.c_str());
 		messageW->refresh();
 		commandW->redraw();
+		break;
 
 
-	} else if (sig.getType() == "/core/module/quit") {
-		sendSignal("/core/module/exits", Core::coreName);
-
+	case Signal::CORE_MODULE_QUIT:
+		sendSignal(Signal::CORE_MODULE_EXITS, Signal::CORE_MODULE);
+		break;
 	}
 }
 
@@ -437,14 +447,14 @@ void UI::handleCommand(const std::string &command) {
 			return;
 		}
 
-		sendSignal("/net/msg/send", chatNetwork,
+		sendSignal(Signal::NET_MSG_SEND, Signal::intern(chatNetwork),
 				   new sig::MessageData(chatUser,
 									std::string(command, pos.first), 0));
 
 	}
 
 	if (len == 5 && (data == "/quit" || data == "/exit")) {
-		sendSignal("/core/module/exits", Core::coreName);
+		sendSignal(Signal::CORE_MODULE_EXITS, Signal::CORE_MODULE);
 		return;
 	}
 
@@ -559,7 +569,7 @@ void UI::handleCommand(const std::string &command) {
 
 			it = usersFound.begin();
 			std::string net = it->first;
-			sendSignal("/net/msg/send", net,
+			sendSignal(Signal::NET_MSG_SEND, Signal::intern(net),
 			           new sig::MessageData(it->second->id,
 		                                std::string(command, pos.first),
 		                                len==3?sig::MessageData::ACTION:0));
@@ -586,8 +596,6 @@ void UI::handleCommand(const std::string &command) {
 			return;
 		}
 
-		/* send to all networks */
-		std::string net = "/net/";
 		pos = nextToken(command, pos.second);
 		if (pos.first == std::string::npos) {
 			data.clear();
@@ -596,10 +604,11 @@ void UI::handleCommand(const std::string &command) {
 		}
 
 		/*
-		 * in UserData we must supply valid data only for these
-		 * information which has changed (status and/or displayname)
+		 * Send to all networks; in UserData we must supply valid
+		 * data only for these information which has changed (status
+		 * and/or displayname)
 		 */
-		sendSignal("/net/status/change", net,
+		sendSignal(Signal::NET_STATUS_CHANGE, Signal::NET_MODULES,
 		           new sig::UserData(User("dummy", Address(),
 		                                  User::Status(state, data)),
 		                             sig::UserData::STATE |
@@ -673,7 +682,8 @@ std::string UI::userName(const std::string &network, const User::ID &id) {
 	NetworkUsers::iterator nit = networkUsers.find(network);
 	if (nit == networkUsers.end()) {
 	not_found:
-		sendSignal("/net/conn/are-you-connected", network);
+		sendSignal(Signal::NET_CONN_ARE_YOU_CONNECTED,
+		           Signal::intern(network));
 		return id.toString();
 	} else {
 		sig::UsersListData::Users::iterator uit = nit->second->users.find(id);
@@ -689,7 +699,8 @@ std::string UI::userName(const std::string &network, const User::ID &id) {
 std::string UI::ourUserName(const std::string &network) {
 	NetworkUsers::iterator nit = networkUsers.find(network);
 	if (nit == networkUsers.end()) {
-		sendSignal("/net/conn/are-you-connected", network);
+		sendSignal(Signal::NET_CONN_ARE_YOU_CONNECTED,
+		           Signal::intern(network));
 		return "I";
 	} else {
 		User &ourUser = nit->second->ourUser;
@@ -711,7 +722,7 @@ int UI::findUsers(const std::string &uri) {
 	/* iterator over networks in networkUsers map */
 	std::map<std::string,shared_obj<sig::UsersListData> >::iterator nuit;
 	/* iterator over users in particular network */
-	std::map<User::ID, User *>::iterator uit;
+	sig::UsersListData::Users::iterator uit;
 
 	usersFound.clear();
 	for(nuit=networkUsers.begin(); nuit!=networkUsers.end(); ++nuit) {
@@ -729,7 +740,7 @@ int UI::findUsers(const std::string &uri) {
 
 bool UI::userExists(const User::ID &user, const std::string &network) {
 	std::map<std::string,shared_obj<sig::UsersListData> >::iterator nuit;
-	std::map<User::ID, User *>::iterator uit;
+	sig::UsersListData::Users::iterator uit;
 	nuit = networkUsers.find(network);
 	if (nuit == networkUsers.end()) {
 		return false;
@@ -42,9 +42,7 @@ struct UI : public Module {
 	/** Frees all resources. */
 	~UI();
 
-	virtual int setFDSets(fd_set *rd, fd_set *wr, fd_set *ex);
-	virtual int doFDs(int nfds, const fd_set *rd, const fd_set *wr,
-	                  const fd_set *ex);
+	virtual void handleFD(int fd, unsigned events);
 	virtual void recievedSignal(const Signal &sig);
 	virtual bool isActiveUI() const;
 
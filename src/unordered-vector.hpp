@@ -452,7 +452,7 @@ struct unordered_vector {
 	 * \return an iterator that points to the inserted data.
 	 */
 	iterator insert(iterator position, const value_type &x) {
-		return data.insert(position, x);
+		return storage.insert(position, x);
 	}
 
 	/**
@@ -470,7 +470,7 @@ struct unordered_vector {
 	 * \param x         data to be inserted.
 	 */
 	void insert(iterator position, size_type n, const value_type &x) {
-		data.storage(position, n, x);
+		storage.insert(position, n, x);
 	}
 
 	/**
@@ -0,0 +1,339 @@
+/** \file
+ * A hash table of users.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_USER_TABLE_HPP
+#define H_USER_TABLE_HPP
+
+#include <assert.h>
+
+#include <utility>
+#include <vector>
+
+#include "user.hpp"
+
+namespace ppc {
+
+
+/**
+ * A map from User::ID to User pointer implemented as an open
+ * addressing hash table.  Entries are kept in a single contiguous
+ * vector (so iterating over them is a linear scan) while a separate
+ * power of two sized array of slots, probed linearly, maps hashes to
+ * positions in that vector.  Each slot holds entry's full hash
+ * (computed once, when the entry is inserted) so mismatching entries
+ * are rejected without touching them and a lookup usually takes
+ * a single probe.
+ *
+ * Interface follows std::map's as far as it makes sense, the
+ * differences being that the order of iteration is unspecified, that
+ * inserting may invalidate all iterators and that erase() returns an
+ * iterator to the element which should be visited next.  Entry's key
+ * must not be modified through an iterator.
+ */
+struct UserTable {
+	/** Key type. */
+	typedef User::ID key_type;
+	/** Mapped type. */
+	typedef User *mapped_type;
+	/** Entry type. */
+	typedef std::pair<User::ID, User *> value_type;
+	/** Type for specyfying table size. */
+	typedef std::size_t size_type;
+
+private:
+	/** A single entry with its precomputed hash. */
+	struct Node {
+		/**
+		 * Constructor.
+		 * \param v entry's value.
+		 * \param h hash of entry's key.
+		 */
+		Node(const value_type &v, unsigned h) : value(v), hash(h) { }
+
+		/** Entry's value. */
+		value_type value;
+		/** Hash of entry's key. */
+		unsigned hash;
+	};
+
+	/** Vector of nodes. */
+	typedef std::vector<Node> Nodes;
+
+public:
+	/** A read/write iterator. */
+	struct iterator {
+		/** Default constructor. */
+		iterator() { }
+		/** Returns reference to entry. */
+		value_type &operator* () const { return  it->value; }
+		/** Returns pointer to entry. */
+		value_type *operator->() const { return &it->value; }
+		/** Pre-increment operator. */
+		iterator &operator++() { ++it; return *this; }
+		/** Post-increment operator. */
+		iterator operator++(int) { iterator tmp(*this); ++it; return tmp; }
+		/** Compares two iterators. */
+		bool operator==(const iterator &i) const { return it == i.it; }
+		/** Compares two iterators. */
+		bool operator!=(const iterator &i) const { return it != i.it; }
+
+	private:
+		/** Constructor. */
+		explicit iterator(Nodes::iterator i) : it(i) { }
+		/** Underlying vector's iterator. */
+		Nodes::iterator it;
+		friend struct UserTable;
+	};
+
+	/** A read-only iterator. */
+	struct const_iterator {
+		/** Default constructor. */
+		const_iterator() { }
+		/** Converts read/write iterator into read-only one. */
+		const_iterator(const iterator &i) : it(i.it) { }
+		/** Returns reference to entry. */
+		const value_type &operator* () const { return  it->value; }
+		/** Returns pointer to entry. */
+		const value_type *operator->() const { return &it->value; }
+		/** Pre-increment operator. */
+		const_iterator &operator++() { ++it; return *this; }
+		/** Post-increment operator. */
+		const_iterator operator++(int) {
+			const_iterator tmp(*this); ++it; return tmp;
+		}
+		/** Compares two iterators. */
+		bool operator==(const const_iterator &i) const { return it == i.it; }
+		/** Compares two iterators. */
+		bool operator!=(const const_iterator &i) const { return it != i.it; }
+
+	private:
+		/** Constructor. */
+		explicit const_iterator(Nodes::const_iterator i) : it(i) { }
+		/** Underlying vector's iterator. */
+		Nodes::const_iterator it;
+		friend struct UserTable;
+	};
+
+
+	/** Creates an empty table. */
+	UserTable() : mask(0) { }
+
+
+	/** Returns an iterator to the first entry. */
+	iterator       begin()       { return       iterator(nodes.begin()); }
+	/** Returns a read-only iterator to the first entry. */
+	const_iterator begin() const { return const_iterator(nodes.begin()); }
+	/** Returns an iterator one past the last entry. */
+	iterator       end  ()       { return       iterator(nodes.end  ()); }
+	/** Returns a read-only iterator one past the last entry. */
+	const_iterator end  () const { return const_iterator(nodes.end  ()); }
+
+	/** Returns number of entries. */
+	size_type size () const { return nodes.size (); }
+	/** Returns whether table is empty. */
+	bool      empty() const { return nodes.empty(); }
+
+
+	/**
+	 * Looks entry up.
+	 * \param key entry's key.
+	 * \return iterator to entry or end() if there is no such entry.
+	 */
+	iterator find(const key_type &key) {
+		const unsigned s = lookup(key, key.hash());
+		return slots.empty() || slots[s].index == EMPTY ? end()
+			: iterator(nodes.begin() + slots[s].index);
+	}
+
+	/**
+	 * Looks entry up.
+	 * \param key entry's key.
+	 * \return iterator to entry or end() if there is no such entry.
+	 */
+	const_iterator find(const key_type &key) const {
+		const unsigned s = lookup(key, key.hash());
+		return slots.empty() || slots[s].index == EMPTY ? end()
+			: const_iterator(nodes.begin() + slots[s].index);
+	}
+
+	/**
+	 * Inserts an entry unless entry with the same key already
+	 * exists.  May invalidate all iterators.
+	 * \param value entry to insert.
+	 * \return a pair whose first element is an iterator to entry
+	 *         with given key and second whether it has been inserted.
+	 */
+	std::pair<iterator, bool> insert(const value_type &value) {
+		const unsigned h = value.first.hash();
+		unsigned s = lookup(value.first, h);
+		if (!slots.empty() && slots[s].index != EMPTY) {
+			return std::make_pair(iterator(nodes.begin() + slots[s].index),
+			                      false);
+		}
+
+		/* Keep load factor at most 1/2. */
+		if ((nodes.size() + 1) * 2 > slots.size()) {
+			rehash(slots.empty() ? 16 : slots.size() * 2);
+			s = lookup(value.first, h);
+		}
+
+		slots[s].hash  = h;
+		slots[s].index = nodes.size();
+		nodes.push_back(Node(value, h));
+		return std::make_pair(iterator(nodes.end() - 1), true);
+	}
+
+	/**
+	 * Removes entry.  Last entry is moved into the removed one's
+	 * place so only iterators to removed and last entries are
+	 * invalidated.
+	 * \param pos iterator to entry to remove.
+	 * \return iterator to entry which took removed one's place (ie. the
+	 *         one which should be visited next when iterating) or
+	 *         end() if removed entry was the last one.
+	 */
+	iterator erase(iterator pos) {
+		const unsigned index = pos.it - nodes.begin();
+		const unsigned last = nodes.size() - 1;
+		assert(index <= last);
+
+		unlink(slotOf(index, pos.it->hash));
+		if (index != last) {
+			*pos.it = nodes.back();
+			slots[slotOf(last, pos.it->hash)].index = index;
+		}
+		nodes.pop_back();
+		return iterator(nodes.begin() + index);
+	}
+
+	/** Removes all entries. */
+	void clear() {
+		nodes.clear();
+		for (Slots::iterator it = slots.begin(); it != slots.end(); ++it) {
+			it->index = EMPTY;
+		}
+	}
+
+private:
+	/** Marker of an empty slot. */
+	static const unsigned EMPTY = ~0u;
+
+	/** A single slot. */
+	struct Slot {
+		/** Hash of entry's key. */
+		unsigned hash;
+		/** Entry's position in nodes vector or EMPTY. */
+		unsigned index;
+	};
+
+	/** Vector of slots. */
+	typedef std::vector<Slot> Slots;
+
+	/** Entries. */
+	Nodes nodes;
+	/** Slots, size is zero or a power of two. */
+	Slots slots;
+	/** Slots' size minus one. */
+	unsigned mask;
+
+
+	/**
+	 * Finds slot holding entry with given key or, if there is no such
+	 * entry, the empty slot where it would be inserted.  Must not be
+	 * used if slots is empty (returns zero then).
+	 * \param key entry's key.
+	 * \param h \a key's hash.
+	 * \return slot's index.
+	 */
+	unsigned lookup(const key_type &key, unsigned h) const {
+		if (slots.empty()) {
+			return 0;
+		}
+		unsigned s = h & mask;
+		for (; slots[s].index != EMPTY; s = (s + 1) & mask) {
+			if (slots[s].hash == h && nodes[slots[s].index].value.first == key) {
+				break;
+			}
+		}
+		return s;
+	}
+
+	/**
+	 * Finds slot pointing to given entry.  The entry must exist.
+	 * \param index entry's position in nodes vector.
+	 * \param h entry's hash.
+	 * \return slot's index.
+	 */
+	unsigned slotOf(unsigned index, unsigned h) const {
+		unsigned s = h & mask;
+		while (slots[s].index != index) {
+			assert(slots[s].index != EMPTY);
+			s = (s + 1) & mask;
+		}
+		return s;
+	}
+
+	/**
+	 * Empties given slot shifting entries which follow it backwards
+	 * so that no lookup chain gets broken (thus no tombstones are
+	 * ever needed).
+	 * \param s slot to empty.
+	 */
+	void unlink(unsigned s) {
+		for (unsigned i = (s + 1) & mask; slots[i].index != EMPTY;
+		     i = (i + 1) & mask) {
+			/* Entry in slot i may be moved to slot s only if its home
+			   slot is not in the cyclic range (s, i]. */
+			const unsigned home = slots[i].hash & mask;
+			if (s < i ? (s < home && home <= i) : (s < home || home <= i)) {
+				continue;
+			}
+			slots[s] = slots[i];
+			s = i;
+		}
+		slots[s].index = EMPTY;
+	}
+
+	/**
+	 * Resizes slots array and reinserts all entries using their
+	 * stored hashes.
+	 * \param size new size, must be a power of two.
+	 */
+	void rehash(size_type size) {
+		Slot empty;
+		empty.hash  = 0;
+		empty.index = EMPTY;
+		slots.assign(size, empty);
+		mask = size - 1;
+
+		const unsigned n = nodes.size();
+		for (unsigned index = 0; index < n; ++index) {
+			unsigned s = nodes[index].hash & mask;
+			while (slots[s].index != EMPTY) {
+				s = (s + 1) & mask;
+			}
+			slots[s].hash  = nodes[index].hash;
+			slots[s].index = index;
+		}
+	}
+};
+
+
+}
+
+#endif
@@ -142,6 +142,24 @@ struct User {
 			return result += ')';
 		}
 
+		/**
+		 * Returns identifier's hash.  Equal identifiers have equal
+		 * hashes and all bits of the result are well mixed so any
+		 * of them may be used to index a hash table.
+		 */
+		unsigned hash() const {
+			unsigned h = 2166136261u;
+			const char *ch = nick.data(), *const end = ch + nick.size();
+			for (; ch != end; ++ch) {
+				h = (h ^ (unsigned char)*ch) * 16777619u;
+			}
+			h = (h ^ (unsigned)address.ip.host()) * 16777619u;
+			h = (h ^ (unsigned)address.port.host()) * 16777619u;
+			h ^= h >> 15;
+			h *= 0x2c1b3c6du;
+			return h ^ (h >> 13);
+		}
+
 		/** User's nick name. */
 		std::string nick;
 		/** Users IP address and port number. */
@@ -21,6 +21,7 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <queue>
 #include <vector>
 
@@ -81,6 +82,26 @@ struct queue<T, vector<T, Alloc> > {
 	 */
 	const_reference front() const { return *first; }
 
+	/**
+	 * Returns a read/write reference to the data at given position
+	 * counting from the first element of the %queue.
+	 * \param n element's position, less then size().
+	 */
+	reference operator[](size_type n) {
+		const size_type pos = (first - c.begin()) + n;
+		return c[pos < c.size() ? pos : pos - c.size()];
+	}
+
+	/**
+	 * Returns a read-only (constant) reference to the data at given
+	 * position counting from the first element of the %queue.
+	 * \param n element's position, less then size().
+	 */
+	const_reference operator[](size_type n) const {
+		const size_type pos = (first - c.begin()) + n;
+		return c[pos < c.size() ? pos : pos - c.size()];
+	}
+
 	/**
 	 * Returns a read/write reference to the data at the last
 	 * element of the %queue.
@@ -111,14 +132,28 @@ struct queue<T, vector<T, Alloc> > {
 	 * \param x Data to be added.
 	 */
 	void push(const value_type &x) {
+		emplace() = x;
+	}
+
+	/**
+	 * Adds an element to the end of the %queue and returns reference
+	 * to it so caller can fill it in place instead of copying a
+	 * temporary.  The element is not reinitialised so it holds
+	 * whatever value was left in the slot; users are expected to
+	 * clear elements before popping them (or overwrite all fields).
+	 *
+	 * \return reference to the added element.
+	 */
+	reference emplace() {
 		if (c.capacity() == count) {
 			moreSpace();
 		}
 		++count;
-		*last = x;
+		reference ret = *last;
 		if (++last == c.end()) {
 			last = c.begin();
 		}
+		return ret;
 	}
 
 	/**
@@ -160,35 +195,23 @@ private:
 	typename vector_type::iterator last;
 
 
-	/** Allocates more space. */
+	/**
+	 * Allocates more space.  Elements are swapped into the new
+	 * vector rather then copied so growing a queue of elements
+	 * holding strings or shared pointers does not copy them.
+	 */
 	void moreSpace() {
-#if 1
-		typename vector_type::size_type pos = first - c.begin();
-		c.resize((count > init_size() ? count : init_size()) * 2);
-		first = c.begin();
-		last = first + count;
-		while (pos) {
-			*last = *first;
-			++first;
-			++last;
-			--pos;
-		}
-#else
-		if (first == c.begin()) {
-			c.resize((count > init_size() ? count : init_size()) * 2);
-		} else {
-			vector_type v((count > init_size() ? count : init_size()) * 2);
-			typename vector_type::iterator end = c.end(), x = v.begin();
-			for (size_type i = count; i; --i) {
-				*x = *first;
-				++x;
-				if (++first == end) first = c.begin();
+		vector_type v((count > init_size() ? count : init_size()) * 2);
+		typename vector_type::iterator end = c.end(), x = v.begin();
+		for (size_type i = count; i; --i, ++x) {
+			std::swap(*x, *first);
+			if (++first == end) {
+				first = c.begin();
 			}
-			c.swap(v);
 		}
+		c.swap(v);
 		first = c.begin();
 		last = first + count;
-#endif
 	}
 
 
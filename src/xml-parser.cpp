@@ -18,12 +18,10 @@
 
 #include <assert.h>
 
-#include <errno.h>
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 #include "xml-parser.hpp"
+#include "xml-scan.hpp"
 #include "shared-buffer.hpp"
 
 
@@ -61,6 +59,45 @@ static char *writeUTF8(char *wr, unsigned long value) {
 
 
 
+/**
+ * Parses numeric character reference.
+ *
+ * \param rd    pointer to the first character after "&#".
+ * \param stop  pointer to the terminating semicolon.
+ * \param value reference to save character's code to.
+ * \return whether reference was valid.
+ */
+static bool parseCharRef(const char *rd, const char *stop,
+                         unsigned long &value) {
+	unsigned base = 10;
+	if (*rd == 'x') {
+		base = 16;
+		++rd;
+	}
+	if (rd == stop) {
+		return false;
+	}
+
+	value = 0;
+	do {
+		const unsigned char ch = *rd, lower = ch | 32;
+		unsigned digit;
+		if (ch >= '0' && ch <= '9') {
+			digit = ch - '0';
+		} else if (base == 16 && lower >= 'a' && lower <= 'f') {
+			digit = lower - 'a' + 10;
+		} else {
+			return false;
+		}
+		if (value > (0xffffffffUL - digit) / base) {
+			return false;
+		}
+		value = value * base + digit;
+	} while (++rd != stop);
+	return true;
+}
+
+
 std::string &unescapeInPlace(std::string &str) {
 	/*
 	 * This method is based on observation that character entity
@@ -86,10 +123,7 @@ std::string &unescapeInPlace(std::string &str) {
 		/* rd points at first char after '&', stop points at ';' */
 		if (*rd=='#') {
 			unsigned long value;
-			char *ch;
-			errno = 0;
-			value = rd[1]=='x'?strtoul(rd+2, &ch, 16):strtoul(rd+1, &ch, 10);
-			if (errno || ch!=stop || value > 0xffffffff) goto invalid;
+			if (!parseCharRef(rd + 1, stop, value)) goto invalid;
 			wr = writeUTF8(wr, value);
 
 		} else if (stop-rd == 2 && rd[1]=='t') {
@@ -124,49 +158,73 @@ std::string &unescapeInPlace(std::string &str) {
 
 
 
-std::string escape(const std::string &str) {
-	std::string::size_type count = 0;
-	const char *rd = str.data(), *const end = rd + str.length();
-
-	for (; rd!=end; ++rd) {
-		/* Yes, 6 as an argument is not a mistake.  We search for
-		   NUL bytes as well. */
-		if (memchr("<>&\"'", *rd, 6)) {
-			++count;
-		}
+/**
+ * Returns entity special character is replaced with by escape().
+ * \param ch one of the characters Scanner::findSpecial looks for.
+ * \return numeric entity (5 characters long or 4 for NUL byte).
+ */
+static inline const char *entity(char ch) {
+	switch (ch) {
+	case '<' : return "&#60;";
+	case '>' : return "&#62;";
+	case '&' : return "&#38;";
+	case '"' : return "&#34;";
+	case '\'': return "&#39;";
+	default  : return "&#0;";
 	}
+}
 
-	if (!count) {
-		return str;
+
+std::string::size_type escapedLength(const char *data,
+                                     std::string::size_type length) {
+	const Scanner &scan = Scanner::best();
+	const char *const end = data + length;
+	const char *it = scan.findSpecial(data, end);
+	/* Each entity is 4 (NUL byte) or 5 bytes long. */
+	for (; it != end; it = scan.findSpecial(it + 1, end)) {
+		length += *it ? 4 : 3;
 	}
+	return length;
+}
 
-	/* OMG....  C++ sucks so much...  Why do I need to create a string
-	   and fill it with NUL bytes if I'm going to overwrite it
-	   anyway?!?!? What about a constructor which allocates memory and
-	   leaves random content inside? */
 
-	std::string result(4*count + str.length(), '\0');
-	char *wr = &result[0];
-	rd = str.data();
+std::string &appendEscaped(std::string &out, const char *data,
+                           std::string::size_type length) {
+	const Scanner &scan = Scanner::best();
+	const char *rd = data, *const end = data + length;
+	const char *it = scan.findSpecial(rd, end);
 
-	do {
-		const char *it = rd;
-		while (it != end && !memchr("<>&\"'", *it, 6)) ++it;
-		if (it!=rd) {
-			memcpy(wr, rd, it - rd);
-			wr += it - rd;
-		}
+	if (it == end) {
+		return out.append(data, length);
+	}
 
-		if (it==end) break;
-		wr += sprintf(wr, "&#%d;", (int)*it);
+	/* Compute exact size so there is at most one reallocation. */
+	out.reserve(out.length() + (it - rd) + escapedLength(it, end - it));
+
+	do {
+		out.append(rd, it - rd).append(entity(*it), *it ? 5 : 4);
 		rd = it + 1;
+		it = scan.findSpecial(rd, end);
+	} while (it != end);
+
+	return out.append(rd, end - rd);
+}
 
-	} while (rd!=end);
 
-	/* In case there were NUL bytes which are converted into 4-byte
-	   entity not 5-byte as other special characters. */
-	result.resize(wr - result.data());
-	return result;
+std::string &escapeInPlace(std::string &str) {
+	const char *const data = str.data(), *const end = data + str.length();
+	if (Scanner::best().findSpecial(data, end) != end) {
+		std::string result;
+		appendEscaped(result, data, str.length());
+		str.swap(result);
+	}
+	return str;
+}
+
+
+std::string escape(const std::string &str) {
+	std::string result;
+	return appendEscaped(result, str);
 }
 
 
@@ -184,21 +242,55 @@ enum State {
 };
 
 
-Tokenizer::Token Tokenizer::nextToken() {
+Tokenizer::Slice Tokenizer::unescape(const Slice &slice) {
+	if (!memchr(slice.data, '&', slice.length)) {
+		return slice;
+	}
+	unescaped.assign(slice.data, slice.length);
+	return Slice(unescapeInPlace(unescaped));
+}
+
+
+
+/**
+ * Converts pointer returned by one of Scanner's functions to position
+ * in buffer.
+ * \param it   pointer returned by Scanner's function.
+ * \param data beginning of buffer.
+ * \param end  end of range passed to Scanner's function.
+ * \return position of \a it or \c std::string::npos if \a it equals \a
+ *         end.
+ */
+static inline std::string::size_type position(const char *it,
+                                              const char *data,
+                                              const char *end) {
+	return it == end ? std::string::npos : it - data;
+}
+
+
+Tokenizer::TokenView Tokenizer::nextTokenView() {
 	std::string::size_type p;
-	Token token;
+	TokenView token;
+
+	if (popPending) {
+		stackNames.resize(stackOffsets.back());
+		stackOffsets.pop_back();
+		popPending = false;
+	}
 
 	if (pos >= buffer.length()) {
 		return token;
 	}
 
 	const char *const data = buffer.data();
+	const char *const end = data + buffer.length();
+	const Scanner &scan = Scanner::best();
 
 
 	switch ((enum State)state) {
 		/* We're starting. */
 	case START:
-		p = buffer.find_first_not_of(" \t\n\f\v", pos);
+		p = position(scan.skipSpaces(data + pos, end), data, end);
 		if (p == std::string::npos) {
 			buffer.clear();
 			pos = 0;
@@ -213,7 +305,7 @@ Tokenizer::Token Tokenizer::nextToken() {
 
 		/* Inside CDATA, */
 	case CDATA:
-		p = buffer.find_first_of("<>", pos);
+		p = position(scan.findTagDelimiter(data + pos, end), data, end);
 		if (p == std::string::npos) {
 			goto shorten_buffer;
 		}
@@ -224,8 +316,7 @@ Tokenizer::Token Tokenizer::nextToken() {
 
 		if (p != dataStart) {
 			token.type = TEXT;
-			token.data.assign(data + dataStart, p - dataStart);
-			unescapeInPlace(token.data);
+			token.data = unescape(Slice(data + dataStart, p - dataStart));
 			state = TAG;
 			dataStart = pos = p + 1;
 			break;
@@ -239,9 +330,9 @@ Tokenizer::Token Tokenizer::nextToken() {
 		state = TAG;
 		dataStart = pos = p + 1;
 	case TAG: {
-		const char *it = data + pos, *const end = data + buffer.length();
+		const char *it = data + pos;
 		if (dataStart == pos && it!=end && *it == '/') ++it;
-		while (it != end && isNameChar(*it)) ++it;
+		it = scan.skipNameChars(it, end);
 		if (it==end) {
 			goto shorten_buffer;
 		}
@@ -254,19 +345,23 @@ Tokenizer::Token Tokenizer::nextToken() {
 		/* It's opening tag */
 		if (data[dataStart] != '/') {
 			token.type = TAG_OPEN;
-			token.data.assign(data + dataStart, pos - dataStart);
+			token.data = Slice(data + dataStart, pos - dataStart);
 			state = TAG_INSIDE;
-			stack.push_back(token.data);
+			stackOffsets.push_back(stackNames.length());
+			stackNames.append(token.data.data, token.data.length);
 			break;
 		}
 
 		/* It's a closing tag */
-		std::string name(data + dataStart + 1, pos - dataStart - 1);
-
-		if (stack.empty()) {
-			throw Error("Closing '" + name + "' where no element open.");
-		} else if (stack.back() != name) {
-			throw Error("Closing '"+name+"' where '"+stack.back()+"' open.");
+		const Slice name(data + dataStart + 1, pos - dataStart - 1);
+
+		if (stackOffsets.empty()) {
+			throw Error("Closing '" + name.str() +
+			            "' where no element open.");
+		} else if (getElement(stackOffsets.size() - 1) != name) {
+			throw Error("Closing '" + name.str() + "' where '" +
+			            getElement(stackOffsets.size() - 1).str() +
+			            "' open.");
 		}
 
 		state = TAG_CLOSING;
@@ -276,7 +371,7 @@ Tokenizer::Token Tokenizer::nextToken() {
 
 		/* It's a cloasing tag or opening after '/' char; waiting for '>'. */
 	case TAG_CLOSING:
-		p = buffer.find_first_not_of(" \t\n\f\v", pos);
+		p = position(scan.skipSpaces(data + pos, end), data, end);
 		if (p == std::string::npos) {
 			buffer.clear();
 			pos = 0;
@@ -288,16 +383,16 @@ Tokenizer::Token Tokenizer::nextToken() {
 		}
 
 		token.type = ELEMENT_CLOSE;
-		token.data = stack.back();
-		stack.pop_back();
-		state = stack.empty() ? START : CDATA;
+		token.data = getElement(stackOffsets.size() - 1);
+		popPending = true;
+		state = stackOffsets.size() == 1 ? START : CDATA;
 		dataStart = pos = p + 1;
 		break;
 
 
 		/* It's opening tag and we have read element name */
 	case TAG_INSIDE:
-		p = buffer.find_first_not_of(" \t\n\f\v", pos);
+		p = position(scan.skipSpaces(data + pos, end), data, end);
 
 		pos = p + 1;
 		if (p == std::string::npos) {
@@ -323,8 +418,7 @@ Tokenizer::Token Tokenizer::nextToken() {
 		/* We are reading attribute name */
 	state_attr:
 	case ATTR: {
-		const char *it = data + pos, *const end = data + buffer.length();
-		while (it != end && isNameChar(*it)) ++it;
+		const char *it = scan.skipNameChars(data + pos, end);
 		if (it==end) {
 			goto shorten_buffer;
 		}
@@ -336,14 +430,14 @@ Tokenizer::Token Tokenizer::nextToken() {
 
 		state = ATTR_GOT_NAME;
 		token.type = ATTR_NAME;
-		token.data.assign(data + dataStart, pos - dataStart);
+		token.data = Slice(data + dataStart, pos - dataStart);
 	}
 		break;
 
 
 		/* Got attribute name, waiting for '=' */
 	case ATTR_GOT_NAME:
-		p = buffer.find_first_not_of(" \t\n\f\v", pos);
+		p = position(scan.skipSpaces(data + pos, end), data, end);
 		if (p == std::string::npos) {
 			buffer.clear();
 			pos = 0;
@@ -361,7 +455,7 @@ Tokenizer::Token Tokenizer::nextToken() {
 
 		/* Got attribute name and '=', waiting for '"' */
 	case ATTR_GOT_EQ:
-		p = buffer.find_first_not_of(" \t\n\f\v", pos);
+		p = position(scan.skipSpaces(data + pos, end), data, end);
 		if (p == std::string::npos) {
 			buffer.clear();
 			pos = 0;
@@ -379,7 +473,7 @@ Tokenizer::Token Tokenizer::nextToken() {
 
 		/* Got attribute name, reading value */
 	case ATTR_RD_VALUE:
-		p = buffer.find_first_of("\"<>", pos);
+		p = position(scan.findValueDelimiter(data + pos, end), data, end);
 		if (p == std::string::npos) {
 			goto shorten_buffer;
 		}
@@ -389,8 +483,7 @@ Tokenizer::Token Tokenizer::nextToken() {
 		}
 
 		token.type = ATTR_VALUE;
-		token.data.assign(data + dataStart, p - dataStart);
-		unescapeInPlace(token.data);
+		token.data = unescape(Slice(data + dataStart, p - dataStart));
 		state = TAG_INSIDE;
 		pos = p + 1;
 		break;
@@ -402,10 +495,6 @@ Tokenizer::Token Tokenizer::nextToken() {
 
 	if (0) {
  shorten_buffer:
-		if (dataStart) {
-			buffer.erase(0, dataStart);
-			dataStart = 0;
-		}
 		pos = buffer.length();
 	}
 	return token;
@@ -413,6 +502,31 @@ Tokenizer::Token Tokenizer::nextToken() {
 
 
 
+void Tokenizer::compact() {
+	/* Data before dataStart and pos is no longer needed. */
+	const std::string::size_type consumed = dataStart < pos ? dataStart : pos;
+	const std::string::size_type length = buffer.length();
+
+	if (consumed == length) {
+		buffer.clear();
+		pos = dataStart = 0;
+	} else if (consumed >= PPC_XML_COMPACT_MIN &&
+	           consumed >= length - consumed) {
+		buffer.erase(0, consumed);
+		pos -= consumed;
+		dataStart -= consumed;
+	} else {
+		return;
+	}
+
+	if (buffer.capacity() > PPC_XML_BUFFER_HIGH_WATER &&
+	    buffer.length() < buffer.capacity() / 4) {
+		std::string(buffer).swap(buffer);
+	}
+}
+
+
+
 void Parser2::open(const std::string &name) {
 	element = name;
 	attributes.clear();
@@ -20,6 +20,7 @@
 #define H_XML_PARSER_HPP
 
 #include <assert.h>
+#include <string.h>
 
 #include <string>
 #include <vector>
@@ -28,6 +29,21 @@
 #include "exception.hpp"
 
 
+/**
+ * Minimal number of consumed bytes at the beginning of
+ * xml::Tokenizer's buffer for them to be removed.  Consumed bytes
+ * are removed only if there are at least as many of them as
+ * remaining bytes so cost of compaction is amortised.
+ */
+#define PPC_XML_COMPACT_MIN          1024
+
+/**
+ * Capacity of xml::Tokenizer's buffer above which buffer is shrunk
+ * when it gets compacted and is mostly empty.
+ */
+#define PPC_XML_BUFFER_HIGH_WATER   65536
+
+
 namespace ppc {
 
 
@@ -96,12 +112,74 @@ inline std::string unescape(const std::string &str) {
 }
 
 
+/**
+ * Returns length data would have after escaping.  \see
+ * appendEscaped(std::string &, const char *, std::string::size_type).
+ *
+ * \param data   data to escape.
+ * \param length length of \a data.
+ * \return length of escaped data.
+ */
+std::string::size_type escapedLength(const char *data,
+                                     std::string::size_type length);
+
+
+/**
+ * Returns length string would have after escaping.
+ * \param str string to escape.
+ * \return length of escaped string.
+ */
+inline std::string::size_type escapedLength(const std::string &str) {
+	return escapedLength(str.data(), str.length());
+}
+
+
+/**
+ * Appends data to string replacing special characters with
+ * entities.  Characters which are replaced are greater then sign
+ * (\<), lower then sign (\>), ampersand (\&), quote sign ("),
+ * apostrophe (') and a NUL byte.  They are all replaced into numeric
+ * entities.
+ *
+ * \param out    string to append escaped data to.
+ * \param data   data to escape.
+ * \param length length of \a data.
+ * \return reference to \a out.
+ */
+std::string &appendEscaped(std::string &out, const char *data,
+                           std::string::size_type length);
+
+
+/**
+ * Appends string to another string replacing special characters
+ * with entities.  \see appendEscaped(std::string &, const char *,
+ * std::string::size_type).
+ *
+ * \param out string to append escaped data to.
+ * \param str string to escape.
+ * \return reference to \a out.
+ */
+inline std::string &appendEscaped(std::string &out,
+                                  const std::string &str) {
+	return appendEscaped(out, str.data(), str.length());
+}
+
+
+/**
+ * Replaces special characters into entities in place.  If there
+ * are no special characters string is left untouched.  \see
+ * appendEscaped(std::string &, const char *, std::string::size_type).
+ *
+ * \param str string to parse.
+ * \return reference to str (after replacing special characters).
+ */
+std::string &escapeInPlace(std::string &str);
+
+
 /**
  * Replaces special characters into entities.  This does the
- * opposite of parseEntities method.  Characters which are
- * replaced are greater then sign (\<), lower then sign (\>),
- * ampersand (\&), quote sign ("), apostrophe (') and a NUL byte.
- * They are all replaced into numeric entities.
+ * opposite of parseEntities method.  \see appendEscaped(std::string
+ * &, const char *, std::string::size_type).
  *
  * \param str string to parse.
  * \return string with special characters replaced with entities.
@@ -173,16 +251,113 @@ struct Tokenizer {
 	};
 
 
+	/**
+	 * A part of a string which does not own its data.  Used by
+	 * TokenView to point into tokenizer's buffer.
+	 */
+	struct Slice {
+		/**
+		 * Constructor.
+		 * \param d pointer to the first character.
+		 * \param l slice's length.
+		 */
+		Slice(const char *d = 0, std::string::size_type l = 0)
+			: data(d), length(l) { }
+
+		/**
+		 * Creates slice pointing to whole string.
+		 * \param str string to point to.
+		 */
+		Slice(const std::string &str)
+			: data(str.data()), length(str.length()) { }
+
+		/** Returns copy of slice's contents as a string. */
+		std::string str() const { return std::string(data, length); }
+
+		/** Returns \c true iff slice is empty. */
+		bool empty() const { return !length; }
+
+		/**
+		 * Returns \c true iff slice is equal to given NUL terminated
+		 * string.
+		 * \param str string to compare to.
+		 */
+		bool operator==(const char *str) const {
+			return !strncmp(data, str, length) && !str[length];
+		}
+
+		/**
+		 * Returns \c true iff slice is equal to given string.
+		 * \param str string to compare to.
+		 */
+		bool operator==(const std::string &str) const {
+			return length == str.length() && !memcmp(data, str.data(), length);
+		}
+
+		/**
+		 * Returns \c true iff slice is equal to another slice.
+		 * \param s slice to compare to.
+		 */
+		bool operator==(const Slice &s) const {
+			return length == s.length && !memcmp(data, s.data, length);
+		}
+
+		/**
+		 * Returns \c false iff slice is equal to given value.
+		 * \param v value to compare to.
+		 */
+		template<class T>
+		bool operator!=(const T &v) const { return !(*this == v); }
+
+		/** Pointer to the first character. */
+		const char *data;
+
+		/** Slice's length. */
+		std::string::size_type length;
+	};
+
+
+	/**
+	 * Token which does not own its data.  Its data points into
+	 * tokenizer's internal buffers and is valid only till the next
+	 * call to any of tokenizer's methods (other then const methods).
+	 */
+	struct TokenView {
+		/**
+		 * Constructor.
+		 * \param t token's type.
+		 * \param d token's data.
+		 */
+		TokenView(enum Type t = END, const Slice &d = Slice())
+			: type(t), data(d) { }
+
+		/** Returns token type. */
+		operator enum Type() const { return type; }
+
+		/** Returns \c true if token's type is not \c END. */
+		operator bool() const { return type != END; }
+
+		/** Token's type. */
+		enum Type type;
+
+		/** Token's data.  \see Token::data */
+		Slice data;
+	};
+
+
 	/** Zeroes tokenizer's its state. */
-	Tokenizer() : pos(0), state(0) { }
+	Tokenizer() : pos(0), dataStart(0), reserved(0), state(0),
+	              popPending(false) { }
 
 
 	/** Initialises tokenizer and zeroes its state. */
 	void init() {
-		stack.clear();
+		stackNames.clear();
+		stackOffsets.clear();
+		popPending = false;
 		buffer.clear();
 		state = 0;
-		pos = 0;
+		pos = dataStart = 0;
 	}
 
 	/**
@@ -190,6 +365,7 @@ struct Tokenizer {
 	 * \param data data to feed tokenizer with.
 	 */
 	void feed(const std::string &data) {
+		compact();
 		buffer += data;
 	}
 
@@ -198,6 +374,7 @@ struct Tokenizer {
 	 * \param data data to feed tokenizer with.
 	 */
 	void feed(const char *data) {
+		compact();
 		buffer += data;
 	}
 
@@ -207,14 +384,55 @@ struct Tokenizer {
 	 * \param len  data's length.
 	 */
 	void feed(const char *data, std::string::size_type len) {
-		buffer.append(data, len);;
+		compact();
+		buffer.append(data, len);
+	}
+
+	/**
+	 * Reserves space at the end of tokenizer's buffer so data can be
+	 * written directly into it (eg. by \c recv()) instead of being
+	 * passed to feed().  After data is written commit() must be
+	 * called before any other method.
+	 *
+	 * \param len number of bytes to reserve.
+	 * \return pointer to \a len writable bytes.
+	 */
+	char *reserve(std::string::size_type len) {
+		compact();
+		reserved = buffer.length();
+		buffer.resize(reserved + len);
+		return &buffer[reserved];
+	}
+
+	/**
+	 * Feeds tokenizer with data written to space returned by the
+	 * last call to reserve().
+	 * \param len number of bytes written, no more then reserved.
+	 */
+	void commit(std::string::size_type len) {
+		buffer.resize(reserved + len);
 	}
 
 	/**
 	 * Returns next token, \c END if there are no more tokens.
 	 * \throw Error if data is missformatted.
 	 */
-	Token nextToken();
+	Token nextToken() {
+		const TokenView token = nextTokenView();
+		return Token(token.type, token.data.str());
+	}
+
+	/**
+	 * Returns next token, \c END if there are no more tokens.  Unlike
+	 * nextToken() it does not copy token's data but returns a slice
+	 * of tokenizer's buffer (entities are unescaped only if data
+	 * contains an ampersand in which case an internal buffer is
+	 * used).  Returned slice is valid till next call to non-const
+	 * tokenizer's method.
+	 *
+	 * \throw Error if data is missformatted.
+	 */
+	TokenView nextTokenView();
 
 	/**
 	 * If tokenizer expects more data exreption is thrown otherwise no
@@ -222,32 +440,74 @@ struct Tokenizer {
 	 * \throw Error if tokenizer is in state that does not allow end of data.
 	 */
 	void done() {
-		if (!stack.empty() || state || !buffer.empty()) {
+		if (getDepth() || state || !buffer.empty()) {
 			throw Error("Unexpected end of data.");
 		}
 	}
 
 
+	/** Returns number of currently opened elements. */
+	std::vector<std::string>::size_type getDepth() const {
+		return stackOffsets.size() - popPending;
+	}
+
 	/**
-	 * Return's current parser's elements stack.  The first element of
-	 * stack is name of the root element and last element is the
-	 * deepest element.
-	 * \return opened elements stack.
+	 * Returns name of an opened element.  Element with index zero is
+	 * the root element and element with index <tt>getDepth() - 1</tt>
+	 * is the deepest element.  Returned slice is valid till next call
+	 * to non-const tokenizer's method.
+	 * \param i element's index, less then getDepth().
 	 */
-	const std::vector<std::string> &getStack() const { return stack; }
+	Slice getElement(std::vector<std::string>::size_type i) const {
+		const std::string::size_type end = i + 1 < stackOffsets.size()
+			? stackOffsets[i + 1] : stackNames.length();
+		return Slice(stackNames.data() + stackOffsets[i],
+		             end - stackOffsets[i]);
+	}
 
 
 private:
-	/** Stack of opened elements. */
-	std::vector<std::string> stack;
+	/** Names of opened elements concatenated together. */
+	std::string stackNames;
+
+	/** Offsets of opened elements' names in stackNames. */
+	std::vector<std::string::size_type> stackOffsets;
+
+	/** Unescaped data of the last token if it contained entities. */
+	std::string unescaped;
 
 	std::string buffer;               /**< Internal buffer. */
 	std::string::size_type pos;       /**< Internal variable. */
 	std::string::size_type dataStart; /**< Internal variable. */
+	std::string::size_type reserved;  /**< Length before reserve(). */
 
 
 	/** Parser's state. */
 	unsigned state;
+
+	/**
+	 * Whether the deepest element was closed.  Removing element's
+	 * name from stack is delayed till next token so that \c
+	 * ELEMENT_CLOSE token's data can point to it.
+	 */
+	bool popPending;
+
+
+	/**
+	 * If \a slice contains entities unescapes it into \a unescaped
+	 * buffer.
+	 * \param slice slice to unescape.
+	 * \return \a slice or slice pointing to \a unescaped.
+	 * \throw Error if data is missformatted.
+	 */
+	Slice unescape(const Slice &slice);
+
+	/**
+	 * Removes already consumed data from the beginning of the buffer
+	 * if there is enough of it.  Also shrinks buffer if its capacity
+	 * exceeded \c PPC_XML_BUFFER_HIGH_WATER and most of it is unused.
+	 */
+	void compact();
 };
 
 
@@ -0,0 +1,348 @@
+/** \file
+ * Fast scanning functions used by XML tokenizer.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "xml-scan.hpp"
+#include "xml-parser.hpp"
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#  define PPC_XML_SCAN_X86 1
+#  include <immintrin.h>
+#else
+#  define PPC_XML_SCAN_X86 0
+#endif
+
+
+namespace ppc {
+
+namespace xml {
+
+
+/******************** Scalar ********************/
+
+static const char *scalarFindTagDelimiter(const char *it, const char *end) {
+	while (it != end && *it != '<' && *it != '>') ++it;
+	return it;
+}
+
+static const char *scalarFindValueDelimiter(const char *it,
+                                            const char *end) {
+	while (it != end && *it != '"' && *it != '<' && *it != '>') ++it;
+	return it;
+}
+
+static const char *scalarSkipSpaces(const char *it, const char *end) {
+	while (it != end && (*it == ' ' || *it == '\t' || *it == '\n' ||
+	                     *it == '\f' || *it == '\v')) ++it;
+	return it;
+}
+
+static const char *scalarSkipNameChars(const char *it, const char *end) {
+	while (it != end && isNameChar(*it)) ++it;
+	return it;
+}
+
+static const char *scalarFindSpecial(const char *it, const char *end) {
+	/* Yes, 6 as an argument is not a mistake.  We search for NUL
+	   bytes as well. */
+	while (it != end && !memchr("<>&\"'", *it, 6)) ++it;
+	return it;
+}
+
+
+const Scanner Scanner::scalar = {
+	scalarFindTagDelimiter,
+	scalarFindValueDelimiter,
+	scalarSkipSpaces,
+	scalarSkipNameChars,
+	scalarFindSpecial,
+	"scalar"
+};
+
+
+
+#if PPC_XML_SCAN_X86
+
+/*
+ * Vector implementations process input in blocks of 16 or 32 bytes.
+ * For each block a mask of interesting bytes is computed and the
+ * position of the first set bit is the result.  The tail shorter
+ * then a block is handled by scalar code so we never read past \a
+ * end.
+ *
+ * There are no unsigned byte comparisons in SSE2 so range checks are
+ * done by shifting the range to the bottom of signed char's range and
+ * doing a signed "less then".
+ */
+
+
+/******************** SSE2 ********************/
+
+#define SSE2 __attribute__((target("sse2")))
+
+SSE2 static inline __m128i sse2InRange(__m128i v, char lo, char hi) {
+	const __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(-128 - lo));
+	return _mm_cmplt_epi8(shifted, _mm_set1_epi8(-128 + (hi - lo) + 1));
+}
+
+SSE2 static inline unsigned sse2NameChars(__m128i v) {
+	const __m128i letters =
+		sse2InRange(_mm_or_si128(v, _mm_set1_epi8(32)), 'a', 'z');
+	const __m128i other =
+		_mm_or_si128(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('-'))),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+	return _mm_movemask_epi8(
+		_mm_or_si128(_mm_or_si128(sse2InRange(v, '0', '9'), letters), other));
+}
+
+SSE2 static const char *sse2FindTagDelimiter(const char *it, const char *end) {
+	const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>');
+	for (; end - it >= 16; it += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)it);
+		const unsigned mask = _mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)));
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return scalarFindTagDelimiter(it, end);
+}
+
+SSE2 static const char *sse2FindValueDelimiter(const char *it,
+                                               const char *end) {
+	const __m128i quot = _mm_set1_epi8('"');
+	const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>');
+	for (; end - it >= 16; it += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)it);
+		const unsigned mask = _mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(v, quot),
+			             _mm_or_si128(_mm_cmpeq_epi8(v, lt),
+			                          _mm_cmpeq_epi8(v, gt))));
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return scalarFindValueDelimiter(it, end);
+}
+
+SSE2 static const char *sse2SkipSpaces(const char *it, const char *end) {
+	const __m128i space = _mm_set1_epi8(' ');
+	for (; end - it >= 16; it += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)it);
+		/* '\t', '\n', '\v' and '\f' are 9, 10, 11 and 12. */
+		const unsigned mask = 0xffff & ~_mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(v, space),
+			             sse2InRange(v, '\t', '\f')));
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return scalarSkipSpaces(it, end);
+}
+
+SSE2 static const char *sse2SkipNameChars(const char *it, const char *end) {
+	for (; end - it >= 16; it += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)it);
+		const unsigned mask = 0xffff & ~sse2NameChars(v);
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return scalarSkipNameChars(it, end);
+}
+
+SSE2 static inline unsigned sse2Special(__m128i v) {
+	return _mm_movemask_epi8(_mm_or_si128(
+		_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')),
+		             _mm_cmpeq_epi8(v, _mm_set1_epi8('>'))),
+		_mm_or_si128(_mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('&')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))), _mm_or_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')),
+			_mm_cmpeq_epi8(v, _mm_setzero_si128())))));
+}
+
+SSE2 static const char *sse2FindSpecial(const char *it, const char *end) {
+	for (; end - it >= 16; it += 16) {
+		const unsigned mask =
+			sse2Special(_mm_loadu_si128((const __m128i*)it));
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return scalarFindSpecial(it, end);
+}
+
+#undef SSE2
+
+
+const Scanner Scanner::sse2 = {
+	sse2FindTagDelimiter,
+	sse2FindValueDelimiter,
+	sse2SkipSpaces,
+	sse2SkipNameChars,
+	sse2FindSpecial,
+	"sse2"
+};
+
+
+
+/******************** AVX2 ********************/
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2InRange(__m256i v, char lo, char hi) {
+	const __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(-128 - lo));
+	return _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + (hi - lo) + 1),
+	                         shifted);
+}
+
+AVX2 static inline unsigned avx2NameChars(__m256i v) {
+	const __m256i letters =
+		avx2InRange(_mm256_or_si256(v, _mm256_set1_epi8(32)), 'a', 'z');
+	const __m256i other =
+		_mm256_or_si256(_mm256_or_si256(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'))),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+	return _mm256_movemask_epi8(
+		_mm256_or_si256(_mm256_or_si256(avx2InRange(v, '0', '9'), letters),
+		                other));
+}
+
+AVX2 static const char *avx2FindTagDelimiter(const char *it, const char *end) {
+	const __m256i lt = _mm256_set1_epi8('<'), gt = _mm256_set1_epi8('>');
+	for (; end - it >= 32; it += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)it);
+		const unsigned mask = _mm256_movemask_epi8(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, lt),
+			                _mm256_cmpeq_epi8(v, gt)));
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return sse2FindTagDelimiter(it, end);
+}
+
+AVX2 static const char *avx2FindValueDelimiter(const char *it,
+                                               const char *end) {
+	const __m256i quot = _mm256_set1_epi8('"');
+	const __m256i lt = _mm256_set1_epi8('<'), gt = _mm256_set1_epi8('>');
+	for (; end - it >= 32; it += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)it);
+		const unsigned mask = _mm256_movemask_epi8(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, quot),
+			                _mm256_or_si256(_mm256_cmpeq_epi8(v, lt),
+			                                _mm256_cmpeq_epi8(v, gt))));
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return sse2FindValueDelimiter(it, end);
+}
+
+AVX2 static const char *avx2SkipSpaces(const char *it, const char *end) {
+	const __m256i space = _mm256_set1_epi8(' ');
+	for (; end - it >= 32; it += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)it);
+		const unsigned mask = ~_mm256_movemask_epi8(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+			                avx2InRange(v, '\t', '\f')));
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return sse2SkipSpaces(it, end);
+}
+
+AVX2 static const char *avx2SkipNameChars(const char *it, const char *end) {
+	for (; end - it >= 32; it += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)it);
+		const unsigned mask = ~avx2NameChars(v);
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return sse2SkipNameChars(it, end);
+}
+
+AVX2 static const char *avx2FindSpecial(const char *it, const char *end) {
+	for (; end - it >= 32; it += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)it);
+		const unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('>'))),
+			_mm256_or_si256(_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))),
+			                _mm256_or_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')),
+				_mm256_cmpeq_epi8(v, _mm256_setzero_si256())))));
+		if (mask) {
+			return it + __builtin_ctz(mask);
+		}
+	}
+	return sse2FindSpecial(it, end);
+}
+
+#undef AVX2
+
+
+const Scanner Scanner::avx2 = {
+	avx2FindTagDelimiter,
+	avx2FindValueDelimiter,
+	avx2SkipSpaces,
+	avx2SkipNameChars,
+	avx2FindSpecial,
+	"avx2"
+};
+
+#endif
+
+
+
+/**
+ * Returns the fastest scanner supported by CPU.
+ */
+static const Scanner &selectScanner() {
+#if PPC_XML_SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return Scanner::avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return Scanner::sse2;
+	}
+#endif
+	return Scanner::scalar;
+}
+
+
+const Scanner &Scanner::best() {
+	static const Scanner &scanner = selectScanner();
+	return scanner;
+}
+
+
+}
+
+}
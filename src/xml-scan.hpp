@@ -0,0 +1,97 @@
+/** \file
+ * Fast scanning functions used by XML tokenizer.
+ * Copyright 2008 by Michal Nazarewicz (mina86/AT/mina86.com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef H_XML_SCAN_HPP
+#define H_XML_SCAN_HPP
+
+
+namespace ppc {
+
+namespace xml {
+
+
+/**
+ * Set of scanning functions.  Each function takes range of
+ * characters and returns pointer to the first character matching
+ * some criteria or \a end if there is no such character.  There are
+ * several implementations (scalar, SSE2 and AVX2) and the fastest
+ * one supported by CPU is chosen at run time.
+ */
+struct Scanner {
+	/**
+	 * Looks for '<' or '>' character.
+	 * \param it  beginning of range.
+	 * \param end end of range.
+	 */
+	const char *(*findTagDelimiter)(const char *it, const char *end);
+
+	/**
+	 * Looks for '"', '<' or '>' character.
+	 * \param it  beginning of range.
+	 * \param end end of range.
+	 */
+	const char *(*findValueDelimiter)(const char *it, const char *end);
+
+	/**
+	 * Looks for character which is not a space, tab, new line, form
+	 * feed nor vertical tab.
+	 * \param it  beginning of range.
+	 * \param end end of range.
+	 */
+	const char *(*skipSpaces)(const char *it, const char *end);
+
+	/**
+	 * Looks for character for which isNameChar() returns \c false.
+	 * \param it  beginning of range.
+	 * \param end end of range.
+	 */
+	const char *(*skipNameChars)(const char *it, const char *end);
+
+	/**
+	 * Looks for a character which escape() replaces with an entity,
+	 * ie. '<', '>', '&', '"', '\'' or a NUL byte.
+	 * \param it  beginning of range.
+	 * \param end end of range.
+	 */
+	const char *(*findSpecial)(const char *it, const char *end);
+
+	/** Implementation's name. */
+	const char *name;
+
+
+	/** Scanner chosen for this CPU. */
+	static const Scanner &best();
+
+	/** Portable scanner. */
+	static const Scanner scalar;
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+	/** Scanner using SSE2 instructions. */
+	static const Scanner sse2;
+
+	/** Scanner using AVX2 instructions. */
+	static const Scanner avx2;
+#endif
+};
+
+
+}
+
+}
+
+#endif